@@ -0,0 +1,69 @@
+/*
+Log the sensors only around the interesting events.
+
+The sensors are asked once a second and kept in a short history. When the RPM goes over 9000, the throttle opens
+or closes by more than 30% between two snapshots, or a new DTC appears, the sensors are asked as fast as the ECU
+answers and printed, starting from the 5 seconds before the event, until 3 seconds after the last one:
+event  millis  GPS  RPM  SPEED  TPS  IAP  IAT  ECT  STPS
+the columns are separated by a tab. The events are H (history), T (trigger), L (live) and E (end of the window).
+*/
+
+#include "KWP2000.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000 ECU(&bike, 13);
+
+sensors_snapshot history[8]; // one each second, a bit more than the pre trigger time
+
+void printSnapshot(const sensors_snapshot &snapshot, const uint8_t event, const uint8_t trigger)
+{
+    const char events[] = {'H', 'T', 'L', 'E'};
+    Serial.print(events[event]);
+    Serial.print('\t');
+    Serial.print(snapshot.time);
+    for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+    {
+        Serial.print('\t');
+        Serial.print(snapshot.value[ch]);
+    }
+    if (event == CAPTURE_TRIGGER)
+    {
+        Serial.print(F("\ttrigger "));
+        Serial.print(trigger);
+    }
+    Serial.println();
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+
+    ECU.setSensorsInterval(1000);
+    ECU.monitorTroubleCodes(10000);
+    ECU.enableCapture(printSnapshot, history, 8);
+    ECU.setCaptureWindow(5000, 3000);
+    ECU.addTrigger(TRIGGER_ABOVE, CH_RPM, 9000);
+    ECU.addTrigger(TRIGGER_DELTA, CH_TPS, 30);
+    ECU.addTrigger(TRIGGER_NEW_DTC);
+}
+
+void loop()
+{
+    if (ECU.getStatus() == false)
+    {
+        ECU.initKline();
+        return;
+    }
+    ECU.update();
+}
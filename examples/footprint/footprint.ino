@@ -0,0 +1,51 @@
+/*
+Compare the RAM and the flash used by different buffer sizes.
+
+The Arduino IDE prints the flash ("Sketch uses") and the global RAM ("Global variables use") at the end
+of the compilation: change RESPONSE_SIZE and REQUEST_SIZE, verify the sketch and compare the numbers.
+Once uploaded it also prints the size of the objects, which is the RAM taken by the library.
+
+RESPONSE_SIZE: the longest response of your ECU, header and checksum included (max 260)
+REQUEST_SIZE: the longest request you will send, header and checksum included (max 260)
+*/
+
+#include "KWP2000.h"
+
+#define RESPONSE_SIZE 64
+#define REQUEST_SIZE 12
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000Sized<RESPONSE_SIZE, REQUEST_SIZE> ECU(&bike, 13);
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+
+    Serial.print(F("KWP2000 with the default buffers: "));
+    Serial.print(sizeof(KWP2000));
+    Serial.println(F(" bytes of RAM"));
+
+    Serial.print(F("KWP2000Sized<"));
+    Serial.print(RESPONSE_SIZE);
+    Serial.print(F(", "));
+    Serial.print(REQUEST_SIZE);
+    Serial.print(F(">: "));
+    Serial.print(sizeof(ECU));
+    Serial.println(F(" bytes of RAM"));
+}
+
+void loop()
+{
+    ECU.keepAlive();
+}
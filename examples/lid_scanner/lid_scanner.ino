@@ -0,0 +1,117 @@
+/*
+Find the local identifiers supported by the ECU.
+
+Send from the serial monitor: the service, the first and the last identifier in hex, e.g.
+21 00 FF
+At the end it prints the support map, one row for each 16 identifiers:
+  S supported   - not supported   R rejected (it exists, e.g. it needs the security access)   ? no answer
+and the data of the supported identifiers as a sample.
+*/
+
+#include "KWP2000.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000 ECU(&bike, 13);
+
+char support_map[256];
+
+void printHex(const uint8_t value)
+{
+    if (value < 0x10)
+    {
+        Serial.print('0');
+    }
+    Serial.print(value, HEX);
+}
+
+void scanned(const uint8_t sid, const uint8_t id, const uint8_t result, const uint8_t data[], const uint16_t len)
+{
+    const char symbol[] = {'S', '-', 'R', '?'};
+    support_map[id] = symbol[result];
+
+    if (result == SCAN_SUPPORTED)
+    {
+        printHex(sid);
+        Serial.print(' ');
+        printHex(id);
+        Serial.print(':');
+        for (uint16_t n = 0; n < len; n++)
+        {
+            Serial.print(' ');
+            printHex(data[n]);
+        }
+        Serial.println();
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+    Serial.println(F("Send: service first last, e.g. 21 00 FF"));
+}
+
+void loop()
+{
+    if (Serial.available() == 0)
+    {
+        ECU.keepAlive();
+        return;
+    }
+
+    char line[16];
+    const uint8_t line_len = Serial.readBytesUntil('\n', line, sizeof(line) - 1);
+    line[line_len] = 0;
+
+    char *end;
+    const uint8_t sid = strtoul(line, &end, 16);
+    const uint8_t first = strtoul(end, &end, 16);
+    const uint8_t last = strtoul(end, &end, 16);
+
+    while (ECU.initKline() == 0)
+    {
+        // connecting
+    }
+
+    memset(support_map, ' ', sizeof(support_map));
+    const uint32_t start = millis();
+    const int16_t supported = ECU.scanIdentifiers(sid, first, last, scanned);
+
+    if (supported < 0)
+    {
+        Serial.println(F("Service not supported or ECU not connected"));
+        return;
+    }
+
+    Serial.println(F("\n   0 1 2 3 4 5 6 7 8 9 A B C D E F"));
+    for (uint8_t row = first >> 4; row <= last >> 4; row++)
+    {
+        Serial.print(row, HEX);
+        Serial.print(F("x "));
+        for (uint8_t col = 0; col < 16; col++)
+        {
+            Serial.print(support_map[row << 4 | col]);
+            Serial.print(' ');
+        }
+        Serial.println();
+        if (row == 0x0F)
+        {
+            break;
+        }
+    }
+
+    Serial.print(supported);
+    Serial.print(F(" supported, scanned in "));
+    Serial.print((millis() - start) / 1000);
+    Serial.println(F(" seconds"));
+}
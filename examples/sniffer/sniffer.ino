@@ -0,0 +1,51 @@
+/*
+Listen to a dealer tool talking to the ECU, the library never transmits.
+
+Connect the K-Line interface as usual and start the dealer tool, every valid frame is printed as:
+millis  REQ|RSP  bytes in hex (header, data and checksum)
+the columns are separated by a tab, so the output can be saved and used by the ECU emulator.
+The sensors values are decoded from the responses to the same request used by the library.
+*/
+
+#include "KWP2000.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000 ECU(&bike, 13);
+
+void printFrame(const uint32_t time, const uint8_t direction, const uint8_t frame[], const uint16_t len)
+{
+    Serial.print(time);
+    Serial.print(direction == FRAME_REQUEST ? F("\tREQ\t") : F("\tRSP\t"));
+    for (uint16_t n = 0; n < len; n++)
+    {
+        if (frame[n] < 0x10)
+        {
+            Serial.print('0');
+        }
+        Serial.print(frame[n], HEX);
+        Serial.print(n < len - 1 ? ' ' : '\n');
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+
+    ECU.startSniffer(printFrame);
+}
+
+void loop()
+{
+    ECU.sniff();
+}
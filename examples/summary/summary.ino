@@ -0,0 +1,84 @@
+/*
+Send a summary of the sensors each minute instead of every value.
+
+The sensors are asked 10 times a second and summarized by a SensorsAggregator, at the end of each minute
+one line is printed for each channel:
+channel  min  max  mean  variance  histogram (8 buckets, see setBuckets())
+the columns are separated by a tab.
+*/
+
+#include "KWP2000.h"
+#include "SensorsAggregator.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000 ECU(&bike, 13);
+
+const char *const channel_name[CH_TOTAL] = {"GPS", "RPM", "SPEED", "TPS", "IAP", "IAT", "ECT", "STPS"};
+
+void printSummary(const sensors_summary &summary)
+{
+    Serial.print(F("window "));
+    Serial.print(summary.start);
+    Serial.print('-');
+    Serial.print(summary.end);
+    Serial.print(F(", snapshots "));
+    Serial.println(summary.count);
+
+    for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+    {
+        const channel_summary &channel = summary.channel[ch];
+        Serial.print(channel_name[ch]);
+        Serial.print('\t');
+        Serial.print(channel.min);
+        Serial.print('\t');
+        Serial.print(channel.max);
+        Serial.print('\t');
+        Serial.print(channel.mean);
+        Serial.print('\t');
+        Serial.print(channel.variance);
+        for (uint8_t b = 0; b < KWP2000_BUCKETS; b++)
+        {
+            Serial.print(b == 0 ? '\t' : ' ');
+            Serial.print(channel.histogram[b]);
+        }
+        Serial.println();
+    }
+}
+
+SensorsAggregator aggregator(60000, printSummary);
+
+void aggregate(const sensors_snapshot &snapshot)
+{
+    aggregator.add(snapshot);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+
+    aggregator.setBuckets(CH_RPM, 1000, 1000); // under 2000, 2000-3000, ... over 8000
+    ECU.setSensorsCallback(aggregate);
+    ECU.setSensorsInterval(100);
+}
+
+void loop()
+{
+    if (ECU.getStatus() == false)
+    {
+        aggregator.flush(); // the last minute before the connection was lost
+        ECU.initKline();
+        return;
+    }
+    ECU.update();
+}
@@ -0,0 +1,60 @@
+/*
+Trace the K-Line to a VCD (Value Change Dump) file, to see the timing in GTKWave without a logic analyzer.
+
+The connection and the sensors requests are traced: save everything printed on the serial monitor in a .vcd file.
+The signals are the TX and RX lines bit by bit, the bytes sent and received, the steps T0-T3 of the fast init,
+the P2 window (waiting for the ECU), the P3 window (the tester can send) and the result of each checksum.
+The events are kept in a buffer while the library talks to the ECU and printed after, so the trace doesn't
+change the timing.
+*/
+
+#include "KWP2000.h"
+#include "VCDWriter.h"
+
+#if defined(ARDUINO_ARCH_ESP32)
+HardwareSerial bike(2); // for the ESP32 core
+#elif defined(ARDUINO_ARCH_STM32)
+HardwareSerial bike(PA3, PA2); // for the stm32duino core
+#else
+#define bike Serial2 // for the Arduino avr core
+#endif
+
+KWP2000 ECU(&bike, 13);
+
+trace_record events[300]; // about two for each byte: a sensors request and its response fit
+VCDWriter vcd(Serial, events, 300);
+
+void trace(const uint32_t time, const uint8_t event, const uint8_t value)
+{
+    vcd.add(time, event, value);
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    while (!Serial)
+    {
+        // wait for connection with the serial
+    }
+
+    vcd.begin();
+    ECU.setTraceCallback(trace);
+    ECU.setSensorsInterval(500);
+}
+
+void loop()
+{
+    if (ECU.getStatus() == false)
+    {
+        if (ECU.initKline() == true)
+        {
+            // the bits are drawn with the line config of the ECU, e.g. the one found by enableAutoBaud()
+            vcd.setLineConfig(ECU.getLineConfig());
+        }
+    }
+    else
+    {
+        ECU.update();
+    }
+    vcd.write();
+}
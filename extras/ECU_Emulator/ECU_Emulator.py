@@ -10,10 +10,15 @@ module needed:
 
 
 
-import serial, time, sys
+import serial, time, sys, math, random, bisect
 from random import randint
 
 default_port = 'COM6' # 'COMx' for windows '/dev/ttyUSBx' for linux
+replay_file = None # a capture of the sniffer example, to answer like a real ECU
+if len(sys.argv) > 1:
+    default_port = sys.argv[1]
+if len(sys.argv) > 2:
+    replay_file = sys.argv[2]
 this_address = 0xf1
 ecu_address = 0x12
 P2m = 40
@@ -55,7 +60,11 @@ atp_limits_ok = [0x80, this_address, ecu_address, 0x07 , 0xC3, 0x0, 1, 2, 3, 4,
 
 request_sens = [[0x80, ecu_address, this_address, 0x2, 0x21, 0x8, 0xae],
                 [0x82, ecu_address, this_address, 0x21, 0x8, 0xae]]
-fake_sens = [0x80, this_address, ecu_address, 0x34]
+fake_sens = [0x80, this_address, ecu_address, 0x34, 0x61, 0x08]
+
+sensors_model = 'ride' # 'ride' for the RideModel, 'random' for random bytes
+bike_profile = 'suzuki' # the scaling used to encode the sensors, see encode_sensors
+ride_seed = 1 # the same seed gives the same ride, None for a different one each time
 
 reject_request = [0x80, this_address, ecu_address, 0x01, 0x7F]
 
@@ -110,6 +119,221 @@ def compare(received,correct):
     return False
 
 
+class RideModel:
+    """
+    A simple ride: the rider opens and closes the throttle, the engine pulls the bike through the gears
+    and the temperatures follow slowly. The values are coupled like on a real bike, so the frames have
+    a realistic correlation from one to the next (for the benchmarks and the compression tests).
+    """
+    gear_ratio = [0, 2.62, 1.95, 1.60, 1.38, 1.24, 1.14] # rpm per km/h divided by 50, 0 is neutral
+    idle_rpm = 1300
+    shift_up_rpm = 8500
+    shift_down_rpm = 3500
+    max_step = 0.1           # s, a longer time is split in steps: the Euler integration diverges with big steps
+
+    def __init__(self, seed=None):
+        self.rng = random.Random(seed)
+        self.t = 0.0
+        self.speed = 0.0         # km/h
+        self.gear = 0
+        self.rpm = self.idle_rpm
+        self.throttle = 0.0      # %
+        self.target = 0.0        # % the rider is going to
+        self.phase_end = 0.0     # s, when the rider changes his mind
+        self.clutch = 0
+        self.ect = 25.0          # degrees C, engine coolant
+        self.iat = 25.0          # degrees C, intake air
+        self.ambient = 25.0
+
+    def _rider(self):
+        # stop, accelerate, cruise or slow down for a random time
+        phase = self.rng.choice(['stop', 'accelerate', 'accelerate', 'cruise', 'cruise', 'slow'])
+        if phase == 'stop':
+            self.target, duration = 0.0, self.rng.uniform(2, 8)
+        elif phase == 'accelerate':
+            self.target, duration = self.rng.uniform(50, 100), self.rng.uniform(3, 10)
+        elif phase == 'cruise':
+            self.target, duration = self.rng.uniform(15, 35), self.rng.uniform(5, 20)
+        else:
+            self.target, duration = self.rng.uniform(0, 8), self.rng.uniform(2, 6)
+        self.phase_end = self.t + duration
+
+    def step(self, dt):
+        """ Move the ride forward by dt seconds and return the sensors values """
+        values = None
+        while values is None or dt > 0:
+            values = self._step(min(dt, self.max_step))
+            dt -= self.max_step
+        return values
+
+    def _step(self, dt):
+        self.t += dt
+        if self.t >= self.phase_end:
+            self._rider()
+
+        # the throttle is not opened instantly: about 100 %/s with a bit of noise
+        delta = max(-150 * dt, min(100 * dt, self.target - self.throttle))
+        self.throttle = max(0.0, min(100.0, self.throttle + delta + self.rng.gauss(0, 0.3)))
+
+        # longitudinal dynamics: traction from the throttle, aerodynamic and rolling drag, engine brake
+        if self.gear == 0 and self.target > 5:
+            self.gear, self.clutch = 1, 1
+        traction = 0.0 if self.gear == 0 else self.throttle / 100 * 12 * self.gear_ratio[self.gear] / self.gear_ratio[1]
+        drag = 0.00045 * self.speed ** 2 + 0.15 + (0.8 if self.throttle < 3 and self.speed > 0 else 0)
+        self.speed = max(0.0, self.speed + (traction - drag) * dt * 3.6)
+
+        # the engine speed follows the wheel, slipping the clutch at low speed
+        if self.gear == 0:
+            wheel_rpm = 0
+        else:
+            wheel_rpm = self.speed * self.gear_ratio[self.gear] * 50
+        if self.gear == 0 or wheel_rpm < self.idle_rpm:
+            self.clutch = 1 if self.gear != 0 else 0
+            target_rpm = self.idle_rpm + self.throttle * 40
+            self.rpm += (target_rpm - self.rpm) * min(1, 4 * dt)
+        else:
+            self.clutch = 0
+            self.rpm = wheel_rpm
+        self.rpm += self.rng.gauss(0, 15)
+
+        # the rider shifts
+        if self.gear != 0 and self.gear < 6 and self.rpm > self.shift_up_rpm:
+            self.gear += 1
+            self.clutch = 1
+        elif self.gear > 1 and self.rpm < self.shift_down_rpm and \
+                self.speed * self.gear_ratio[self.gear - 1] * 50 < self.shift_up_rpm * 0.8:
+            self.gear -= 1
+            self.clutch = 1
+        elif self.speed < 1 and self.target <= 5:
+            self.gear = 0
+
+        # the coolant warms up to the thermostat and the air in the airbox warms up when the bike is slow
+        self.ect += ((90 if self.rpm > self.idle_rpm else 80) - self.ect) * dt / 120 + self.rng.gauss(0, 0.02)
+        self.iat += ((self.ambient + 25 * math.exp(-self.speed / 30)) - self.iat) * dt / 60 + self.rng.gauss(0, 0.02)
+
+        iap = 30 + 70 * self.throttle / 100 * (1 - 0.3 * self.rpm / 12000) # kPa, closed throttle is vacuum
+        return {'rpm': max(0, self.rpm), 'speed': self.speed, 'tps': self.throttle, 'iap': iap,
+                'ect': self.ect, 'iat': self.iat, 'stps': min(100, self.throttle * 1.1),
+                'gear': self.gear, 'clutch': self.clutch}
+
+
+def encode_sensors(values, profile):
+    """
+    Encode the sensors values in the data of the response, the inverse of the scaling of the library
+    (see requestSensorsData in KWP2000.cpp and the PIDs in PIDs.h). The indexes count the header too
+    """
+    data = [0] * 52
+    def put(pid, value):
+        data[pid - 4] = int(max(0, min(255, round(value))))
+
+    if profile == 'suzuki':
+        data[0], data[1] = 0x61, 0x08
+        rpm = min(values['rpm'], 2550 + 25) # rpm = H * 10 + L / 10
+        high = min(255, int(rpm // 10))
+        put(17, high)
+        put(18, (rpm - high * 10) * 10)
+        put(16, values['speed'] / 2)
+        put(19, 55 + values['tps'] * (256 - 55) / 125)
+        put(20, values['iap'] / (4 * 0.136))
+        put(21, values['ect'] * 1.6 + 48)
+        put(22, values['iat'] * 1.6 + 48)
+        put(24, 13.8 * 126 / 100) # battery
+        put(26, values['gear'])
+        put(47, values['stps'] * 2.55)
+        put(52, values['clutch'])
+    else:
+        # the other bikes have no scaling in the library yet
+        data = [randint(0, 255) for _ in data]
+    return data
+
+
+def frame_payload(frame):
+    """ The data of a frame: without the header and the checksum """
+    header = 3 if frame[0] & 0xC0 else 1
+    length = frame[0] & 0x3F
+    if length == 0:
+        length = frame[header]
+        header += 1
+    return tuple(frame[header:header + length])
+
+
+class ReplayProfile:
+    """
+    Answer like the ECU of a capture made with the sniffer example (lines "millis<TAB>REQ|RSP<TAB>hex bytes").
+    Each request gets the responses recorded for it in the same order they were recorded, after a P2 drawn
+    from the latencies recorded for it: the benchmarks see the timing of that ECU, not the one of the emulator.
+    A request never recorded gets the responses of the nearest one (same SID, longest common prefix).
+    """
+    byte_time = 11 / 10400.0 # s, one byte on the K-Line: start, 8 data, parity, stop
+
+    def __init__(self, file_name, seed=None):
+        self.rng = random.Random(seed)
+        self.answers = {}   # request payload -> list of lists of response frames, in time order
+        self.latency = {}   # request payload -> sorted P2 in seconds
+        self.cursor = {}    # request payload -> next answer
+
+        last_request, last_time, responses = None, 0, []
+        with open(file_name) as capture:
+            for line in capture:
+                fields = line.strip().split('\t')
+                if len(fields) != 3 or fields[1] not in ('REQ', 'RSP'):
+                    continue
+                frame = [int(x, 16) for x in fields[2].split()]
+                millis = int(fields[0])
+                if fields[1] == 'REQ':
+                    self._add(last_request, responses)
+                    last_request, last_time, responses = frame_payload(frame), millis, []
+                elif last_request is not None:
+                    if not responses:
+                        # the timestamps are at the end of the frames: remove the time to send the response
+                        p2 = (millis - last_time) / 1000.0 - len(frame) * self.byte_time
+                        bisect.insort(self.latency.setdefault(last_request, []), max(0.0, p2))
+                    responses.append(frame[:-1]) # the checksum is added by send()
+            self._add(last_request, responses)
+
+        print("Replay of " + file_name + ": " + str(len(self.answers)) + " requests")
+        for request, p2 in sorted(self.latency.items()):
+            print("  " + " ".join("%02X" % x for x in request) + ":\t" + str(len(p2)) + " times, P2 min " +
+                  "%.1f median %.1f p95 %.1f ms" % (p2[0] * 1000, p2[len(p2) // 2] * 1000, p2[int(len(p2) * 0.95)] * 1000))
+
+    def _add(self, request, responses):
+        if request is not None and responses:
+            self.answers.setdefault(request, []).append(responses)
+
+    def _nearest(self, request):
+        if request in self.answers:
+            return request
+        best, best_len = None, 0
+        for recorded in self.answers:
+            if recorded[0] != request[0]:
+                continue
+            common = 1
+            while common < min(len(recorded), len(request)) and recorded[common] == request[common]:
+                common += 1
+            if common > best_len:
+                best, best_len = recorded, common
+        return best
+
+    def answer(self, frame):
+        """ Send the recorded answer to the request, return False if there isn't one """
+        request = self._nearest(frame_payload(frame))
+        if request is None:
+            return False
+
+        n = self.cursor.get(request, 0)
+        self.cursor[request] = (n + 1) % len(self.answers[request])
+        p2 = self.rng.choice(self.latency[request]) if request in self.latency else 0
+        time.sleep(max(0.0, p2 - P2m / 1000.0)) # listen() already waited P2m
+        for response in self.answers[request][n]:
+            send(list(response))
+        return True
+
+
+replay = ReplayProfile(replay_file) if replay_file else None
+ride = RideModel(ride_seed)
+last_ride_step = time.time()
+
+
 # calculate the checksum
 def calc_cs (arr):
     return sum(arr) & 0xFF
@@ -197,7 +421,8 @@ while 1:
             if compare(request,start_com):
                 print('\nConnection established\n')
                 send(start_com_ok)
-                ECU_connected = True   
+                ECU_connected = True
+                last_ride_step = time.time() # the ride goes on from where it stopped   
 
             else:
                 print('You should send me the init sequence! not this:')
@@ -237,12 +462,22 @@ while 1:
             if compare(request,start_com):
                 print("Already connected")
             
+            elif replay is not None and not compare(request, stop_com) and \
+                    replay.answer([int(x, 16) for x in request]):
+                print("Replayed:", request)
+
             elif compare(request,request_sens):
                 print("Sending fake sensor data\n")
-                for i in range(0,52):
-                    fake_sens.append(randint(0,255))
+                if sensors_model == 'ride':
+                    now = time.time()
+                    data = encode_sensors(ride.step(now - last_ride_step), bike_profile)
+                    last_ride_step = now
+                    fake_sens.extend(data[2:])
+                else:
+                    for i in range(0,50):
+                        fake_sens.append(randint(0,255))
                 send(fake_sens)
-                del fake_sens[4:]
+                del fake_sens[6:]
             
             elif compare (request, stop_com):   
                 print("The tester closed the link")
@@ -0,0 +1,351 @@
+/*
+Minimal Arduino API for Linux hosts, see Arduino.h
+*/
+
+#include "Arduino.h"
+
+#include <asm/ioctls.h>
+#include <asm/termbits.h> // termios2, for the non standard baudrates like 10400
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+extern "C" int ioctl(int fd, unsigned long request, ...); // <sys/ioctl.h> conflicts with <asm/termbits.h>
+
+HardwareSerial Serial;
+
+static HardwareSerial *k_out_port[64]; // pin -> serial port which emulates it with the break
+static uint8_t pin_level[64];
+
+////////////// TIME ////////////////
+
+static uint64_t now_us()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+static const uint64_t start_us = now_us();
+
+unsigned long millis()
+{
+    return (now_us() - start_us) / 1000;
+}
+
+unsigned long micros()
+{
+    return now_us() - start_us;
+}
+
+void delay(unsigned long ms)
+{
+    delayMicroseconds(ms * 1000);
+}
+
+void delayMicroseconds(unsigned int us)
+{
+    struct timespec wait = {(time_t)(us / 1000000), (long)(us % 1000000) * 1000};
+    while (nanosleep(&wait, &wait) == -1 && errno == EINTR)
+    {
+        // interrupted by a signal, sleep the remaining time
+    }
+}
+
+////////////// PINS ////////////////
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+    (void)pin;
+    (void)mode;
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+    if (pin >= 64)
+    {
+        return;
+    }
+    pin_level[pin] = value;
+    if (k_out_port[pin] != nullptr)
+    {
+        k_out_port[pin]->setBreak(value);
+    }
+}
+
+int digitalRead(uint8_t pin)
+{
+    return pin < 64 ? pin_level[pin] : LOW;
+}
+
+long random(long max)
+{
+    return max > 0 ? ::random() % max : 0;
+}
+
+long random(long min, long max)
+{
+    return min + random(max - min);
+}
+
+////////////// PRINT ////////////////
+
+size_t Print::write(const uint8_t buffer[], size_t len)
+{
+    size_t n = 0;
+    while (n < len && write(buffer[n]) == 1)
+    {
+        n++;
+    }
+    return n;
+}
+
+size_t Print::print(const __FlashStringHelper *string)
+{
+    return print(reinterpret_cast<const char *>(string));
+}
+
+size_t Print::print(const char string[])
+{
+    return write(reinterpret_cast<const uint8_t *>(string), strlen(string));
+}
+
+size_t Print::print(char c)
+{
+    return write((uint8_t)c);
+}
+
+size_t Print::print(unsigned char value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(int value, int base)
+{
+    return print((long)value, base);
+}
+
+size_t Print::print(unsigned int value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(long value, int base)
+{
+    if (value < 0 && base == DEC)
+    {
+        return print('-') + printNumber(-value, base);
+    }
+    return printNumber(value, base);
+}
+
+size_t Print::print(unsigned long value, int base)
+{
+    return printNumber(value, base);
+}
+
+size_t Print::print(double value, int digits)
+{
+    char text[32];
+    snprintf(text, sizeof(text), "%.*f", digits, value);
+    return print(text);
+}
+
+size_t Print::printNumber(unsigned long value, int base)
+{
+    char text[8 * sizeof(long) + 1];
+    char *c = &text[sizeof(text) - 1];
+    *c = 0;
+    if (base < 2)
+    {
+        base = DEC;
+    }
+    do
+    {
+        const uint8_t digit = value % base;
+        *--c = digit < 10 ? '0' + digit : 'A' + digit - 10;
+        value /= base;
+    } while (value > 0);
+    return print(c);
+}
+
+#define PRINTLN(T)                       \
+    size_t Print::println(T value)       \
+    {                                    \
+        return print(value) + println(); \
+    }
+#define PRINTLN_BASE(T)                        \
+    size_t Print::println(T value, int base)   \
+    {                                          \
+        return print(value, base) + println(); \
+    }
+
+PRINTLN(const __FlashStringHelper *)
+PRINTLN(const char *)
+PRINTLN(char)
+PRINTLN_BASE(unsigned char)
+PRINTLN_BASE(int)
+PRINTLN_BASE(unsigned int)
+PRINTLN_BASE(long)
+PRINTLN_BASE(unsigned long)
+PRINTLN_BASE(double)
+
+size_t Print::println()
+{
+    return print('\n');
+}
+
+////////////// SERIAL ////////////////
+
+/**
+ * @brief A serial port on a tty, without a device it is the console
+ *
+ * @param device The tty, e.g. "/dev/ttyUSB0"
+ */
+HardwareSerial::HardwareSerial(const char device[]) : _device(device)
+{
+}
+
+/**
+ * @brief Emulate this pin with the break of the serial port, used for the fast init
+ *
+ * @param pin The `k_out_pin` given to the library
+ */
+void HardwareSerial::attachKOutPin(uint8_t pin)
+{
+    if (pin < 64)
+    {
+        k_out_port[pin] = this;
+    }
+}
+
+void HardwareSerial::begin(unsigned long baudrate, uint8_t config)
+{
+    if (_device == nullptr)
+    {
+        return; // the console is always ready
+    }
+
+    if (_fd < 0)
+    {
+        // it is opened once: the break must work even between end() and begin()
+        _fd = open(_device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+        if (_fd < 0)
+        {
+            perror(_device);
+            return;
+        }
+    }
+
+    struct termios2 tio;
+    ioctl(_fd, TCGETS2, &tio);
+    tio.c_iflag = 0;
+    tio.c_oflag = 0;
+    tio.c_lflag = 0;
+    tio.c_cflag = CS8 | CREAD | CLOCAL | BOTHER;
+    if (config == SERIAL_8E1 || config == SERIAL_8O1)
+    {
+        tio.c_cflag |= PARENB;
+        if (config == SERIAL_8O1)
+        {
+            tio.c_cflag |= PARODD;
+        }
+    }
+    tio.c_ispeed = baudrate;
+    tio.c_ospeed = baudrate;
+    tio.c_cc[VMIN] = 0;
+    tio.c_cc[VTIME] = 0;
+    if (ioctl(_fd, TCSETS2, &tio) != 0)
+    {
+        perror(_device);
+    }
+    ioctl(_fd, TCFLSH, TCIOFLUSH);
+    _peeked = -1;
+}
+
+void HardwareSerial::end()
+{
+    // the tty stays open for the break, see begin()
+    _peeked = -1;
+}
+
+int HardwareSerial::available()
+{
+    if (_device == nullptr || _fd < 0)
+    {
+        return 0;
+    }
+    int waiting = 0;
+    ioctl(_fd, FIONREAD, &waiting);
+    return waiting + (_peeked >= 0 ? 1 : 0);
+}
+
+int HardwareSerial::read()
+{
+    if (_peeked >= 0)
+    {
+        const int c = _peeked;
+        _peeked = -1;
+        return c;
+    }
+    uint8_t c;
+    if (_fd < 0 || ::read(_fd, &c, 1) != 1)
+    {
+        return -1;
+    }
+    return c;
+}
+
+int HardwareSerial::peek()
+{
+    if (_peeked < 0)
+    {
+        _peeked = read();
+    }
+    return _peeked;
+}
+
+void HardwareSerial::flush()
+{
+    if (_fd >= 0)
+    {
+        ioctl(_fd, TCSBRK, 1); // tcdrain()
+    }
+    else if (_device == nullptr)
+    {
+        fflush(stdout);
+    }
+}
+
+size_t HardwareSerial::write(uint8_t c)
+{
+    if (_device == nullptr)
+    {
+        return fputc(c, stdout) == EOF ? 0 : 1;
+    }
+    return _fd >= 0 && ::write(_fd, &c, 1) == 1 ? 1 : 0;
+}
+
+HardwareSerial::operator bool()
+{
+    return _device == nullptr || _fd >= 0;
+}
+
+/**
+ * @brief Drive the TX line: `LOW` is the break, `HIGH` is the idle level
+ *
+ * @param level The level of the K out pin
+ */
+void HardwareSerial::setBreak(uint8_t level)
+{
+    if (_fd < 0 && _device != nullptr)
+    {
+        _fd = open(_device, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    }
+    if (_fd >= 0)
+    {
+        ioctl(_fd, level == LOW ? TIOCSBRK : TIOCCBRK);
+    }
+}
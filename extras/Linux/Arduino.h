@@ -0,0 +1,106 @@
+/*
+Minimal Arduino API for Linux hosts, enough to build the KWP2000 library for a gateway.
+See README.md in this folder.
+
+HardwareSerial is a tty (e.g. a USB K-Line interface), millis() and delay() use the monotonic clock.
+The K out pin of the fast init is emulated with the break of the serial port: attach it with
+`bike.attachKOutPin(pin)` and the library will drive the line through `digitalWrite()`.
+*/
+
+#ifndef ARDUINO_LINUX_H
+#define ARDUINO_LINUX_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define HIGH 1
+#define LOW 0
+#define INPUT 0
+#define OUTPUT 1
+#define DEC 10
+#define HEX 16
+#define BIN 2
+
+// only the bits used by the library: parity
+#define SERIAL_8N1 0x06
+#define SERIAL_8E1 0x26
+#define SERIAL_8O1 0x36
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bitSet(value, bit) ((value) |= (1UL << (bit)))
+#define bitClear(value, bit) ((value) &= ~(1UL << (bit)))
+
+class __FlashStringHelper;
+#define F(string_literal) (reinterpret_cast<const __FlashStringHelper *>(string_literal))
+#define PROGMEM
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+int digitalRead(uint8_t pin);
+long random(long max);
+long random(long min, long max);
+
+class Print
+{
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t buffer[], size_t len);
+
+    size_t print(const __FlashStringHelper *string);
+    size_t print(const char string[]);
+    size_t print(char c);
+    size_t print(unsigned char value, int base = DEC);
+    size_t print(int value, int base = DEC);
+    size_t print(unsigned int value, int base = DEC);
+    size_t print(long value, int base = DEC);
+    size_t print(unsigned long value, int base = DEC);
+    size_t print(double value, int digits = 2);
+
+    size_t println(const __FlashStringHelper *string);
+    size_t println(const char string[]);
+    size_t println(char c);
+    size_t println(unsigned char value, int base = DEC);
+    size_t println(int value, int base = DEC);
+    size_t println(unsigned int value, int base = DEC);
+    size_t println(long value, int base = DEC);
+    size_t println(unsigned long value, int base = DEC);
+    size_t println(double value, int digits = 2);
+    size_t println();
+
+  private:
+    size_t printNumber(unsigned long value, int base);
+};
+
+class HardwareSerial : public Print
+{
+  public:
+    HardwareSerial(const char device[] = nullptr);
+    void attachKOutPin(uint8_t pin);
+
+    void begin(unsigned long baudrate, uint8_t config = SERIAL_8N1);
+    void end();
+    int available();
+    int read();
+    int peek();
+    void flush();
+    size_t write(uint8_t c);
+    using Print::write;
+    operator bool();
+
+    void setBreak(uint8_t level);
+
+  private:
+    const char *_device;
+    int _fd = -1;
+    int _peeked = -1;
+};
+
+extern HardwareSerial Serial; // the console, used for the debug
+
+#endif
@@ -0,0 +1,461 @@
+/*
+Diagnostic gateway: it owns the session with the ECU and serves the requests of the local tools through a Unix socket.
+
+usage: kwp2000_gateway [-s socket] [-b baudrate] [-i sensors interval] [-m shm name] tty
+
+Protocol, one line for each request and for each answer:
+    [high|normal|low] hex bytes of the request     e.g. "18 00 FF 00" or "high 1A 90"
+    OK hex bytes of the response                   from the SID, without header and checksum
+    NRC code                                       rejected by the ECU
+    ERR code                                       the library error, or -100 if the queue is full
+
+- identical requests waiting in the queue, or arrived while the same request was on the bus, are sent once
+  and the response goes to all the clients which asked it
+- the requests are served by priority class, the oldest first. A request is promoted to the next class
+  after AGING ms in the queue, so even the low class is never starved
+- the sensors keep their interval, but after each sensors request a waiting client request goes first: a
+  sensors transaction longer than the interval can't starve the clients. With -m the sensors are published
+  in shared memory (see kwp2000_shm.h)
+*/
+
+#include "Arduino.h"
+#include "KWP2000.h"
+#include "kwp2000_shm.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define K_OUT_PIN 1       // any number, it is emulated with the break of the tty
+#define MAX_CLIENTS 32    // one bit each in pending::clients
+#define MAX_PENDING 64
+#define MAX_REQUEST 64    // bytes of a request
+#define LINE_LEN 256
+#define AGING 500         // ms in the queue before a promotion to the next class
+#define REPLY_LEN (3 + 3 * ISO_MAX_DATA + 2) // "OK", " XX" for each byte of the longest response, newline and terminator
+
+enum priority_class
+{
+    CLASS_HIGH,
+    CLASS_NORMAL,
+    CLASS_LOW,
+    CLASS_TOTAL
+};
+
+struct client
+{
+    int fd;
+    char line[LINE_LEN];
+    uint16_t line_len;
+};
+
+struct pending
+{
+    uint8_t request[MAX_REQUEST];
+    uint8_t len;
+    uint8_t priority;
+    uint32_t clients; // bit mask of the clients waiting for the response
+    uint32_t queued;  // millis() when it has been queued
+};
+
+static client clients[MAX_CLIENTS];
+static pending queue[MAX_PENDING];
+static uint8_t queue_len = 0;
+static pending in_flight; // the request on the bus, its clients grow while we wait for the ECU
+static uint8_t flying = false;
+static uint8_t client_turn = false; // after a sensors request a waiting client goes first
+
+static kwp2000_shm *shm = nullptr;
+static volatile sig_atomic_t running = true;
+
+static void stop(int)
+{
+    running = false;
+}
+
+static void publish(const sensors_snapshot &snapshot)
+{
+    if (shm != nullptr)
+    {
+        kwp2000_shm_publish(shm, snapshot);
+    }
+}
+
+static void reply(const uint32_t mask, const char text[])
+{
+    for (uint8_t c = 0; c < MAX_CLIENTS; c++)
+    {
+        if ((mask & (1UL << c)) != 0 && clients[c].fd >= 0)
+        {
+            if (send(clients[c].fd, text, strlen(text), MSG_NOSIGNAL) < 0)
+            {
+                // it will be closed by the next poll
+            }
+        }
+    }
+}
+
+static void closeClient(const uint8_t c)
+{
+    close(clients[c].fd);
+    clients[c].fd = -1;
+
+    // nobody else could be waiting for these
+    in_flight.clients &= ~(1UL << c);
+    for (uint8_t p = 0; p < queue_len;)
+    {
+        queue[p].clients &= ~(1UL << c);
+        if (queue[p].clients == 0)
+        {
+            queue[p] = queue[--queue_len];
+        }
+        else
+        {
+            p++;
+        }
+    }
+}
+
+/**
+ * @brief Parse a line of a client and queue its request, or join an identical one
+ */
+static void queueRequest(const uint8_t c, char line[])
+{
+    uint8_t priority = CLASS_NORMAL;
+    char *text = line;
+
+    if (strncmp(text, "high ", 5) == 0)
+    {
+        priority = CLASS_HIGH;
+        text += 5;
+    }
+    else if (strncmp(text, "normal ", 7) == 0)
+    {
+        text += 7;
+    }
+    else if (strncmp(text, "low ", 4) == 0)
+    {
+        priority = CLASS_LOW;
+        text += 4;
+    }
+
+    uint8_t request[MAX_REQUEST];
+    uint8_t len = 0;
+    char *end;
+    for (;;)
+    {
+        const unsigned long value = strtoul(text, &end, 16);
+        if (end == text)
+        {
+            break;
+        }
+        if (value > 0xFF || len == MAX_REQUEST)
+        {
+            reply(1UL << c, "ERR -1\n");
+            return;
+        }
+        request[len++] = value;
+        text = end;
+    }
+    if (len == 0)
+    {
+        return; // empty line
+    }
+
+    if (flying == true && in_flight.len == len && memcmp(in_flight.request, request, len) == 0)
+    {
+        // the same request is on the bus right now
+        in_flight.clients |= 1UL << c;
+        return;
+    }
+
+    for (uint8_t p = 0; p < queue_len; p++)
+    {
+        if (queue[p].len == len && memcmp(queue[p].request, request, len) == 0)
+        {
+            queue[p].clients |= 1UL << c;
+            if (priority < queue[p].priority)
+            {
+                queue[p].priority = priority;
+            }
+            return;
+        }
+    }
+
+    if (queue_len == MAX_PENDING)
+    {
+        reply(1UL << c, "ERR -100\n");
+        return;
+    }
+
+    pending &entry = queue[queue_len++];
+    memcpy(entry.request, request, len);
+    entry.len = len;
+    entry.priority = priority;
+    entry.clients = 1UL << c;
+    entry.queued = millis();
+}
+
+/**
+ * @brief Read what a client sent, every complete line is a request
+ */
+static void readClient(const uint8_t c)
+{
+    client &cl = clients[c];
+    const ssize_t got = recv(cl.fd, &cl.line[cl.line_len], LINE_LEN - 1 - cl.line_len, MSG_DONTWAIT);
+    if (got <= 0)
+    {
+        if (got == 0 || (errno != EAGAIN && errno != EINTR))
+        {
+            closeClient(c);
+        }
+        return;
+    }
+    cl.line_len += got;
+
+    char *start = cl.line;
+    char *newline;
+    while ((newline = (char *)memchr(start, '\n', &cl.line[cl.line_len] - start)) != nullptr)
+    {
+        *newline = 0;
+        queueRequest(c, start);
+        start = newline + 1;
+    }
+    cl.line_len = &cl.line[cl.line_len] - start;
+    memmove(cl.line, start, cl.line_len);
+    if (cl.line_len == LINE_LEN - 1)
+    {
+        cl.line_len = 0; // a line too long, throw it away
+    }
+}
+
+/**
+ * @brief Accept the new clients and read their requests, without waiting more than `timeout` ms
+ */
+static void serveSockets(const int server, const int timeout)
+{
+    struct pollfd fds[MAX_CLIENTS + 1];
+    uint8_t index[MAX_CLIENTS + 1];
+    nfds_t n = 0;
+
+    fds[n].fd = server;
+    fds[n].events = POLLIN;
+    n++;
+    for (uint8_t c = 0; c < MAX_CLIENTS; c++)
+    {
+        if (clients[c].fd >= 0)
+        {
+            fds[n].fd = clients[c].fd;
+            fds[n].events = POLLIN;
+            index[n] = c;
+            n++;
+        }
+    }
+
+    if (poll(fds, n, timeout) <= 0)
+    {
+        return;
+    }
+
+    for (nfds_t i = 1; i < n; i++)
+    {
+        if (fds[i].revents != 0)
+        {
+            readClient(index[i]);
+        }
+    }
+
+    if ((fds[0].revents & POLLIN) != 0)
+    {
+        // all the clients connected while we were on the bus, their requests are probably already here
+        int fd;
+        while ((fd = accept4(server, nullptr, nullptr, SOCK_NONBLOCK)) >= 0)
+        {
+            uint8_t c = 0;
+            while (c < MAX_CLIENTS && clients[c].fd >= 0)
+            {
+                c++;
+            }
+            if (c == MAX_CLIENTS)
+            {
+                close(fd); // too many clients
+                continue;
+            }
+            clients[c].fd = fd;
+            clients[c].line_len = 0;
+            readClient(c);
+        }
+    }
+}
+
+/**
+ * @brief Take the next request from the queue: the highest class, the oldest first. The aging promotes the old ones
+ *
+ * @return `true` if there is a request, now in `in_flight`
+ */
+static uint8_t nextRequest()
+{
+    const uint32_t now = millis();
+    int16_t best = -1;
+    uint8_t best_class = CLASS_TOTAL;
+
+    for (uint8_t p = 0; p < queue_len; p++)
+    {
+        const uint32_t promotions = (now - queue[p].queued) / AGING;
+        const uint8_t effective = promotions >= queue[p].priority ? (uint8_t)CLASS_HIGH : queue[p].priority - promotions;
+        if (effective < best_class || (effective == best_class && (int32_t)(queue[p].queued - queue[best].queued) < 0))
+        {
+            best = p;
+            best_class = effective;
+        }
+    }
+
+    if (best < 0)
+    {
+        return false;
+    }
+    in_flight = queue[best];
+    queue[best] = queue[--queue_len];
+    return true;
+}
+
+static void sendInFlight(KWP2000 &ECU, const int server)
+{
+    flying = true;
+    const int8_t result = ECU.handleRequest(in_flight.request, in_flight.len);
+
+    // the requests arrived during the transaction can join it
+    serveSockets(server, 0);
+    flying = false;
+
+    char text[REPLY_LEN];
+    if (result == true)
+    {
+        const uint8_t *data = ECU.getResponseData();
+        const uint16_t len = ECU.getResponseLength();
+        uint16_t used = snprintf(text, sizeof(text), "OK");
+        for (uint16_t n = 0; n < len; n++)
+        {
+            used += snprintf(&text[used], sizeof(text) - used, " %02X", data[n]);
+        }
+        snprintf(&text[used], sizeof(text) - used, "\n");
+    }
+    else if (ECU.getLastNRC() != 0)
+    {
+        snprintf(text, sizeof(text), "NRC %02X\n", ECU.getLastNRC());
+    }
+    else
+    {
+        snprintf(text, sizeof(text), "ERR %d\n", result);
+    }
+    reply(in_flight.clients, text);
+}
+
+int main(int argc, char *argv[])
+{
+    const char *socket_path = "/tmp/kwp2000.sock";
+    const char *shm_name = nullptr;
+    uint32_t baudrate = 10400;
+    uint16_t interval = 100;
+
+    int option;
+    while ((option = getopt(argc, argv, "s:b:i:m:")) != -1)
+    {
+        switch (option)
+        {
+        case 's':
+            socket_path = optarg;
+            break;
+        case 'b':
+            baudrate = strtoul(optarg, nullptr, 10);
+            break;
+        case 'i':
+            interval = strtoul(optarg, nullptr, 10);
+            break;
+        case 'm':
+            shm_name = optarg;
+            break;
+        default:
+            break;
+        }
+    }
+    if (optind >= argc)
+    {
+        fprintf(stderr, "usage: %s [-s socket] [-b baudrate] [-i sensors interval] [-m shm name] tty\n", argv[0]);
+        return 1;
+    }
+
+    if (shm_name != nullptr && (shm = kwp2000_shm_create(shm_name)) == nullptr)
+    {
+        perror(shm_name);
+        return 1;
+    }
+
+    const int server = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+    struct sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    strncpy(address.sun_path, socket_path, sizeof(address.sun_path) - 1);
+    unlink(socket_path);
+    if (server < 0 || bind(server, (struct sockaddr *)&address, sizeof(address)) != 0 || listen(server, 8) != 0)
+    {
+        perror(socket_path);
+        return 1;
+    }
+    for (uint8_t c = 0; c < MAX_CLIENTS; c++)
+    {
+        clients[c].fd = -1;
+    }
+
+    HardwareSerial bike(argv[optind]);
+    bike.attachKOutPin(K_OUT_PIN);
+    KWP2000 ECU(&bike, K_OUT_PIN, baudrate);
+    ECU.setSensorsCallback(publish);
+    ECU.setSensorsInterval(interval);
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    uint32_t last_sensors = 0;
+    while (running)
+    {
+        serveSockets(server, queue_len > 0 || ECU.getStatus() == false ? 0 : 5);
+
+        if (ECU.getStatus() == false)
+        {
+            ECU.initKline(); // non blocking until the start communication request
+            continue;
+        }
+
+        const uint8_t sensors_due = interval != 0 && millis() - last_sensors >= interval && (client_turn == false || queue_len == 0);
+        if (sensors_due == false && nextRequest() == true)
+        {
+            sendInFlight(ECU, server);
+            client_turn = false;
+        }
+        else
+        {
+            if (sensors_due == true)
+            {
+                last_sensors = millis();
+                client_turn = true;
+            }
+            ECU.update(); // sensors, DTC monitor and keep alive
+        }
+    }
+
+    while (ECU.stopKline() == 0)
+    {
+        // closing the session
+    }
+    close(server);
+    unlink(socket_path);
+    if (shm != nullptr)
+    {
+        kwp2000_shm_close(shm, shm_name);
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+/*
+Connect to the ECU and publish every sensors snapshot in shared memory, see kwp2000_shm.h
+
+usage: kwp2000_publisher /dev/ttyUSB0 [/kwp2000] [baudrate]
+*/
+
+#include "Arduino.h"
+#include "KWP2000.h"
+#include "kwp2000_shm.h"
+
+#include <signal.h>
+#include <stdio.h>
+
+#define K_OUT_PIN 1 // any number, it is emulated with the break of the tty
+
+static kwp2000_shm *shm = nullptr;
+static volatile sig_atomic_t running = true;
+
+static void publish(const sensors_snapshot &snapshot)
+{
+    kwp2000_shm_publish(shm, snapshot);
+}
+
+static void stop(int)
+{
+    running = false;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s tty [shm name] [baudrate]\n", argv[0]);
+        return 1;
+    }
+    const char *name = argc > 2 ? argv[2] : "/kwp2000";
+    const uint32_t baudrate = argc > 3 ? strtoul(argv[3], nullptr, 10) : 10400;
+
+    shm = kwp2000_shm_create(name);
+    if (shm == nullptr)
+    {
+        perror(name);
+        return 1;
+    }
+
+    HardwareSerial bike(argv[1]);
+    bike.attachKOutPin(K_OUT_PIN);
+    KWP2000 ECU(&bike, K_OUT_PIN, baudrate);
+    ECU.setSensorsCallback(publish);
+    ECU.setSensorsInterval(1); // as fast as the ECU answers
+
+    signal(SIGINT, stop);
+    signal(SIGTERM, stop);
+
+    while (running)
+    {
+        if (ECU.getStatus() == false)
+        {
+            if (ECU.initKline() == 0)
+            {
+                continue; // init sequence in progress
+            }
+        }
+        ECU.update();
+    }
+
+    while (ECU.stopKline() == 0)
+    {
+        // closing the session
+    }
+    kwp2000_shm_close(shm, name);
+    return 0;
+}
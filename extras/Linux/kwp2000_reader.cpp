@@ -0,0 +1,48 @@
+/*
+Print the sensors published by kwp2000_publisher, an example of reader
+
+usage: kwp2000_reader [/kwp2000]
+*/
+
+#include "Arduino.h"
+#include "kwp2000_shm.h"
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    const char *name = argc > 1 ? argv[1] : "/kwp2000";
+    const kwp2000_shm *shm = kwp2000_shm_open(name);
+    if (shm == nullptr)
+    {
+        fprintf(stderr, "%s: not published or different version\n", name);
+        return 1;
+    }
+
+    printf("time\tGPS\tRPM\tSPEED\tTPS\tIAP\tIAT\tECT\tSTPS\n");
+    uint64_t next = shm->count.load();
+    sensors_snapshot snapshot;
+    for (;;)
+    {
+        while (kwp2000_shm_next(shm, next, snapshot))
+        {
+            printf("%u", (unsigned)snapshot.time);
+            for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+            {
+                printf("\t%u", snapshot.value[ch]);
+            }
+            printf("\n");
+        }
+        fflush(stdout);
+        delay(10);
+        int8_t reopened;
+        while ((reopened = kwp2000_shm_reopen(name, shm)) < 0)
+        {
+            delay(1000); // the publisher exited, wait for the next one
+        }
+        if (reopened == 1)
+        {
+            next = 0; // a new segment
+        }
+    }
+}
@@ -0,0 +1,308 @@
+/*
+Sensors snapshots in POSIX shared memory, for the processes on the same host as the gateway.
+
+One writer (kwp2000_publisher) and any number of readers. Each snapshot goes in the next slot
+of a ring, every slot is protected by a seqlock: the readers never block the writer and never
+take a lock, they copy the slot and try again if it changed in the meantime.
+
+Reader:
+    kwp2000_shm *shm = kwp2000_shm_open("/kwp2000");
+    sensors_snapshot snapshot;
+    if (kwp2000_shm_latest(shm, snapshot)) ...
+    uint64_t next = 0;
+    while (kwp2000_shm_next(shm, next, snapshot)) ... // every snapshot, in order
+    if (kwp2000_shm_reopen("/kwp2000", shm) == 1) next = 0; // from time to time
+
+A publisher that restarts after a crash keeps the segment and its count, the readers don't notice.
+A publisher that exits cleanly marks the segment closed and removes it: the readers keep the old
+mapping, which never changes again, until they re-open the name with `kwp2000_shm_reopen()`.
+
+Link with -lrt on old glibc.
+*/
+
+#ifndef KWP2000_SHM_H
+#define KWP2000_SHM_H
+
+#include <atomic>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "KWP2000.h"
+
+#ifndef KWP2000_SHM_RING
+#define KWP2000_SHM_RING 256 ///< how many snapshots are kept, about 10 seconds at frame rate
+#endif
+
+#ifndef KWP2000_SHM_RETRIES
+#define KWP2000_SHM_RETRIES 100000 ///< how many times a slot is read again while the writer is in it, then the writer is considered dead
+#endif
+
+#define KWP2000_SHM_MAGIC 0x4B575032 ///< "KWP2"
+#define KWP2000_SHM_VERSION 2
+
+/**
+ * @brief One slot of the ring
+ */
+struct kwp2000_shm_slot
+{
+    std::atomic<uint32_t> sequence; ///< odd while the writer is changing the slot
+    uint64_t index;                 ///< which snapshot is in the slot, the first one is 0
+    sensors_snapshot snapshot;
+};
+
+/**
+ * @brief The shared memory segment
+ */
+struct kwp2000_shm
+{
+    uint32_t magic;
+    uint16_t version;
+    uint16_t channels;            ///< CH_TOTAL of the writer
+    uint32_t ring_size;           ///< KWP2000_SHM_RING of the writer
+    std::atomic<uint32_t> closed; ///< set by `kwp2000_shm_close()`, the readers must re-open the segment
+    std::atomic<uint64_t> count; ///< snapshots published, the last one is count - 1
+    kwp2000_shm_slot ring[KWP2000_SHM_RING];
+};
+
+/**
+ * @brief Create the segment, used by the writer. A segment left by a writer of the same version that
+ * crashed is kept as it is, so the readers continue from the last snapshot
+ *
+ * @param name The name of the segment, e.g. "/kwp2000"
+ * @return The segment, `nullptr` in case of error
+ */
+inline kwp2000_shm *kwp2000_shm_create(const char name[])
+{
+    const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    if (ftruncate(fd, sizeof(kwp2000_shm)) != 0)
+    {
+        close(fd);
+        return nullptr;
+    }
+    void *memory = mmap(nullptr, sizeof(kwp2000_shm), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    kwp2000_shm *shm = static_cast<kwp2000_shm *>(memory);
+    if (shm->magic == KWP2000_SHM_MAGIC && shm->version == KWP2000_SHM_VERSION &&
+        shm->channels == CH_TOTAL && shm->ring_size == KWP2000_SHM_RING)
+    {
+        // restarted after a crash: resetting count would leave the readers waiting for it to grow back
+        for (uint32_t i = 0; i < KWP2000_SHM_RING; i++)
+        {
+            const uint32_t sequence = shm->ring[i].sequence.load(std::memory_order_relaxed);
+            if ((sequence & 1) != 0)
+            {
+                shm->ring[i].index = UINT64_MAX; // killed while writing it, the content is not valid
+                shm->ring[i].sequence.store(sequence + 1, std::memory_order_release);
+            }
+        }
+        shm->closed.store(0, std::memory_order_release);
+        return shm;
+    }
+
+    memset(memory, 0, sizeof(kwp2000_shm));
+    shm->version = KWP2000_SHM_VERSION;
+    shm->channels = CH_TOTAL;
+    shm->ring_size = KWP2000_SHM_RING;
+    std::atomic_thread_fence(std::memory_order_release);
+    shm->magic = KWP2000_SHM_MAGIC; // the readers wait for it
+    return shm;
+}
+
+/**
+ * @brief Close and remove the segment, used by the writer when it exits
+ *
+ * @param shm The segment from `kwp2000_shm_create()`
+ * @param name The name of the segment
+ */
+inline void kwp2000_shm_close(kwp2000_shm *shm, const char name[])
+{
+    shm->closed.store(1, std::memory_order_release);
+    munmap(shm, sizeof(kwp2000_shm));
+    shm_unlink(name);
+}
+
+/**
+ * @brief Publish a snapshot, used by the writer: call it from the sensors callback
+ *
+ * @param shm The segment from `kwp2000_shm_create()`
+ * @param snapshot The snapshot
+ */
+inline void kwp2000_shm_publish(kwp2000_shm *shm, const sensors_snapshot &snapshot)
+{
+    const uint64_t index = shm->count.load(std::memory_order_relaxed);
+    kwp2000_shm_slot &slot = shm->ring[index % KWP2000_SHM_RING];
+
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed); // odd: writing
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.index = index;
+    slot.snapshot = snapshot;
+    slot.sequence.store(sequence + 2, std::memory_order_release); // even: done
+
+    shm->count.store(index + 1, std::memory_order_release);
+}
+
+/**
+ * @brief Map the segment of the writer, used by the readers
+ *
+ * @param name The name of the segment, e.g. "/kwp2000"
+ * @return The segment, `nullptr` if it doesn't exist or it has been created by a different version
+ */
+inline const kwp2000_shm *kwp2000_shm_open(const char name[])
+{
+    const int fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0)
+    {
+        return nullptr;
+    }
+    void *memory = mmap(nullptr, sizeof(kwp2000_shm), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (memory == MAP_FAILED)
+    {
+        return nullptr;
+    }
+
+    const kwp2000_shm *shm = static_cast<const kwp2000_shm *>(memory);
+    if (shm->magic != KWP2000_SHM_MAGIC || shm->version != KWP2000_SHM_VERSION ||
+        shm->channels != CH_TOTAL || shm->ring_size != KWP2000_SHM_RING)
+    {
+        munmap(memory, sizeof(kwp2000_shm));
+        return nullptr;
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    return shm;
+}
+
+/**
+ * @brief Open the segment again if the writer closed it, used by the readers from time to time
+ *
+ * @param name The name of the segment
+ * @param shm The segment from `kwp2000_shm_open()`, or `nullptr`: it is replaced by the new one
+ * @return `0` if it is still the same, `1` if it has been opened again (the snapshots start again from
+ *          `0`), `-1` if the writer closed it and there isn't a new one yet
+ */
+inline int8_t kwp2000_shm_reopen(const char name[], const kwp2000_shm *&shm)
+{
+    if (shm != nullptr && shm->closed.load(std::memory_order_acquire) == 0)
+    {
+        return 0;
+    }
+    if (shm != nullptr)
+    {
+        munmap(const_cast<kwp2000_shm *>(shm), sizeof(kwp2000_shm));
+    }
+    shm = kwp2000_shm_open(name);
+    if (shm == nullptr || shm->closed.load(std::memory_order_acquire) != 0)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+/**
+ * @brief Copy a snapshot, if it is still in the ring
+ *
+ * @param shm The segment from `kwp2000_shm_open()`
+ * @param index Which snapshot
+ * @param snapshot Where the snapshot is copied
+ * @return `true` if it has been copied, `false` if it has been overwritten, not published yet or the writer 
+ *          died while writing the slot
+ */
+inline bool kwp2000_shm_read(const kwp2000_shm *shm, const uint64_t index, sensors_snapshot &snapshot)
+{
+    const kwp2000_shm_slot &slot = shm->ring[index % KWP2000_SHM_RING];
+    for (uint32_t retry = 0; retry < KWP2000_SHM_RETRIES; retry++)
+    {
+        const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+        if ((before & 1) != 0)
+        {
+            continue; // the writer is in the slot, it takes less than a microsecond
+        }
+        const uint64_t slot_index = slot.index;
+        sensors_snapshot copy = slot.snapshot;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != before)
+        {
+            continue; // changed while copying
+        }
+        if (slot_index != index)
+        {
+            return false;
+        }
+        snapshot = copy;
+        return true;
+    }
+    return false; // a writer killed in the slot leaves it odd forever
+}
+
+/**
+ * @brief Copy the last snapshot
+ *
+ * @param shm The segment from `kwp2000_shm_open()`
+ * @param snapshot Where the snapshot is copied
+ * @return `true` if there is a snapshot, `false` if nothing has been published yet
+ */
+inline bool kwp2000_shm_latest(const kwp2000_shm *shm, sensors_snapshot &snapshot)
+{
+    for (;;)
+    {
+        const uint64_t count = shm->count.load(std::memory_order_acquire);
+        if (count == 0)
+        {
+            return false;
+        }
+        if (kwp2000_shm_read(shm, count - 1, snapshot))
+        {
+            return true;
+        }
+        if (shm->count.load(std::memory_order_acquire) == count)
+        {
+            return false; // the writer is stuck in the slot
+        }
+        // a whole ring has been written since we read count, try with the new one
+    }
+}
+
+/**
+ * @brief Copy the snapshots in order, without losing any if called often enough
+ *
+ * @param shm The segment from `kwp2000_shm_open()`
+ * @param next The index of the next snapshot, start with `0`. It skips the lost ones
+ * @param snapshot Where the snapshot is copied
+ * @return `true` if a snapshot has been copied, `false` if there aren't new ones
+ */
+inline bool kwp2000_shm_next(const kwp2000_shm *shm, uint64_t &next, sensors_snapshot &snapshot)
+{
+    for (;;)
+    {
+        const uint64_t count = shm->count.load(std::memory_order_acquire);
+        if (next >= count)
+        {
+            return false;
+        }
+        if (count - next > KWP2000_SHM_RING)
+        {
+            next = count - KWP2000_SHM_RING; // too slow, the oldest ones have been overwritten
+        }
+        if (kwp2000_shm_read(shm, next, snapshot))
+        {
+            next++;
+            return true;
+        }
+        next++;
+    }
+}
+
+#endif
@@ -24,26 +24,90 @@ OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SO
 #include "PIDs.h"
 
 #define maybe 2 ///< used when we don't know yet the behaviour of the K-Line
-
-//#define FAHRENHEIT ///< decomment it if you want to use Fahrenheit instead of Celsius degrees
-#define TO_FAHRENHEIT(x) x * 1.8 + 32                                                   ///< the formula for the conversion
+#define DEBUG_AT(level) ((level) <= KWP2000_DEBUG_MAX && _flags.debug_enabled == true && _debug_level >= (level)) ///< the first check is done at compile time and removes the message
+#define TRACE(event, value)                                              \
+    do                                                                   \
+    {                                                                    \
+        if (KWP2000_TRACE && _trace_callback != nullptr)                 \
+        {                                                                \
+            _trace_callback(KWP2000_MICROS(), (event), (value));         \
+        }                                                                \
+    } while (0) ///< give an event to the trace callback, removed with `KWP2000_TRACE=0`
+
+//#define FAHRENHEIT ///< decomment it if you want to start with Fahrenheit instead of Celsius degrees, see setTemperatureUnit()
 #define LEN(x) ((sizeof(x) / sizeof(0 [x])) / ((size_t)(!(sizeof(x) % sizeof(0 [x]))))) ///< complex but safe macro for the lenght
 
 // These values are defined by the ISO protocol
-#define ISO_MAX_DATA 260 ///< maximum lenght of a response from the ecu: 255 data + 4 header + 1 checksum
-
 #define ISO_T_P1 10 ///< inter byte time for ECU response - min: 0 max: 20
 #define ISO_T_P2_MIN_LIMIT 50
 #define ISO_T_P2_MAX_LIMIT 89600 ///< P2 time between tester request and ECU response or two ECU responses
 #define ISO_T_P3_MAX_LIMIT 89600 ///< P3 time between end of ECU responses and start of new tester request
 #define ISO_T_P4_MAX_LIMIT 20    ///< inter byte time for tester request
+#define ISO_T_BUS_BUSY 300       ///< longer than the longest frame at 10400 baud, then the bus is not just busy
 // P2 (min & max), P3 (min & max) and P4 (min) are defined by the ECU with accessTimingParameter()
 
 // Initialization
 #define ISO_T_IDLE_NEW 2000         ///< min 300, max undefinied
+#define ISO_T_IDLE_MIN 300          ///< before the next line config, see enableAutoBaud()
 #define ISO_T_INIL (unsigned int)25 ///< Initialization low time
 #define ISO_T_WUP (unsigned int)50  ///< Wake up Pattern
 
+// Persistent storage, see enableStorage()
+#define STORAGE_MAGIC 0x4B ///< first byte of every record, change it when the records change
+#define STORAGE_LINK 0     ///< offset of the link record: key bytes and timing parameters
+#define STORAGE_ID (STORAGE_LINK + 2 + sizeof(link_record)) ///< offset of the ECU identification record
+#define STORAGE_CALIBRATION (STORAGE_ID + 2 + sizeof(ecu_id_t)) ///< offset of the learned throttle calibration
+#define STORAGE_LINE (STORAGE_CALIBRATION + 2 + sizeof(calibration_record)) ///< offset of the line config found by the auto-detection
+
+/**
+ * @brief What we remember about the link to skip the timing parameters at the next `initKline()`
+ */
+struct link_record
+{
+    uint16_t key_bytes;
+    uint8_t atp[5]; ///< P2 min, P2 max, P3 min, P3 max, P4 min as sent by the ECU
+};
+
+/**
+ * @brief The learned throttle calibration of a bike, see `learnThrottle()`
+ */
+struct calibration_record
+{
+    uint32_t fingerprint; ///< of the ECU, `0` if its identification was not read
+    calibration_t tps;
+    calibration_t stps;
+};
+
+/**
+ * @brief The calibration of the channels from `CH_SPEED`, until `setCalibration()`
+ */
+const calibration_t default_calibration[CH_TOTAL - CH_SPEED] = {
+    {0, 100, 0, 200}, // SPEED: raw * 2
+    {55, 255, 0, 124}, // TPS: 125 * (raw - 55) / (256 - 55)
+    {0, 250, 0, 136},  // IAP: raw * 4 * 0.136
+    {48, 208, 0, 100}, // IAT: (raw - 48) / 1.6
+    {48, 208, 0, 100}, // ECT: (raw - 48) / 1.6
+    {0, 255, 0, 100},  // STPS: raw / 2.55
+};
+
+/**
+ * @brief The line configs tried by `enableAutoBaud()` without a list of your own
+ */
+const line_config_t default_line_candidates[] = {
+    {10400, SERIAL_8O1},
+    {10400, SERIAL_8N1}, // as written in the ISO 14230
+    {10400, SERIAL_8E1},
+    {9600, SERIAL_8N1},
+    {9600, SERIAL_8O1},
+};
+
+/**
+ * @brief The retry policy of the services without one of their own, see `setRetryPolicy()`
+ */
+const retry_policy_t default_retry_policy = {3, 0, {0, 0}, 0, 0};
+
+const uint8_t layout_header_len[LAYOUT_TOTAL] = {1, 2, 3, 4}; ///< header lenght of each `frame_layout`
+
 /**
  * @brief This is a a collection of  possible ECU Errors
  */
@@ -65,23 +129,67 @@ enum error_enum
     EE_ATP,    ///< problem setting the timing parameter
     EE_WR,     ///< We get a reject for a request we didn't sent
     EE_US,     ///< not supported, yet
+    EE_BUFFER, ///< the response or the request doesn't fit in the buffers
+    EE_BUS,    ///< the bus was never idle or somebody else talked over our request
+    EE_BREAKER, ///< a service has been stopped after too many failures, see setRetryPolicy()
     EE_TOTAL   ///< this is just to know how many possible errors are in this enum
 };
 
 ////////////// CONSTRUCTOR ////////////////
 
 /**
- * @brief Constructor for the KWP2000 class
+ * @brief Constructor for the KWP2000 class, it is called by `KWP2000Sized` which owns the buffers
  * 
  * @param kline_serial The Serial port you will use to communicate with the ECU
  * @param k_out_pin The TX pin of this serial
- * @param kline_baudrate Optional, defaut to `10400`. The baudrate for the kline, 
+ * @param kline_baudrate The baudrate for the kline
+ * @param response The buffer for the responses of the ECU
+ * @param response_size The lenght of `response`
+ * @param request The buffer for the requests to the ECU
+ * @param request_size The lenght of `request`
  */
-KWP2000::KWP2000(HardwareSerial *kline_serial, const uint8_t k_out_pin, const uint32_t kline_baudrate)
+KWP2000Base::KWP2000Base(KWP2000_SERIAL *kline_serial, const uint8_t k_out_pin, const uint32_t kline_baudrate,
+                         uint8_t response[], const uint16_t response_size, uint8_t request[], const uint16_t request_size)
+    : _response(response), _response_size(response_size), _request(request), _request_size(request_size)
 {
     _kline = kline_serial;
     _kline_baudrate = kline_baudrate;
+    _kline_config = SERIAL_8O1;
+    _line_default.baudrate = kline_baudrate;
+    _line_default.config = SERIAL_8O1;
     _k_out_pin = k_out_pin;
+
+    _flags.init_sequence_started = false;
+    _flags.stop_sequence_started = false;
+    _flags.ECU_status = false;
+    _flags.debug_enabled = false;
+    _flags.dealer_mode = false;
+    _flags.dtc_valid = false;
+    _flags.dtc_stale = false;
+    _flags.dtc_by_status = maybe;
+    _flags.id_valid = false;
+    _flags.silent_keep_alive = maybe;
+    _flags.sniffing = false;
+    _flags.capturing = false;
+    _flags.gear_sensor = maybe;
+    _flags.gear_learning = true;
+    _flags.throttle_learning = false;
+    _flags.auto_baud = false;
+    _flags.all_responses = false;
+#ifdef FAHRENHEIT
+    _flags.fahrenheit = true;
+#else
+    _flags.fahrenheit = false;
+#endif
+    for (uint8_t ch = CH_SPEED; ch < CH_TOTAL; ch++)
+    {
+        resetCalibration(ch);
+    }
+
+    _link.length_byte = true;
+    _link.addresses = true;
+    _link.timing = true; // normal
+    updateLayout();
 }
 
 ////////////// SETUP ////////////////
@@ -93,14 +201,14 @@ KWP2000::KWP2000(HardwareSerial *kline_serial, const uint8_t k_out_pin, const ui
  * @param debug_level Optional, default to `DEBUG_LEVEL_DEFAULT`. The verbosity of the debug
  * @param debug_baudrate Optional, default to `115200`. The baudrate for the debug
  */
-void KWP2000::enableDebug(HardwareSerial *debug_serial, const uint8_t debug_level, const uint32_t debug_baudrate)
+void KWP2000Base::enableDebug(HardwareSerial *debug_serial, const uint8_t debug_level, const uint32_t debug_baudrate)
 {
     _debug = debug_serial;
     _debug->begin(debug_baudrate);
     _debug_level = debug_level;
-    _debug_enabled = true;
+    _flags.debug_enabled = true;
 
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
         _debug->println(F("Debug enabled"));
     }
@@ -111,18 +219,19 @@ void KWP2000::enableDebug(HardwareSerial *debug_serial, const uint8_t debug_leve
  * 
  * @param debug_level choose between DEBUG_LEVEL_NONE DEBUG_LEVEL_DEFAULT DEBUG_LEVEL_VERBOSE
  */
-void KWP2000::setDebugLevel(const uint8_t debug_level)
+void KWP2000Base::setDebugLevel(const uint8_t debug_level)
 {
     _debug_level = debug_level;
-    if (_debug_level == DEBUG_LEVEL_NONE)
+    if (_debug_level == DEBUG_LEVEL_NONE || _debug == nullptr)
     {
-        _debug_enabled = false;
+        // without a debug port enableDebug() has never been called
+        _flags.debug_enabled = false;
     }
     else
     {
-        _debug_enabled = true;
+        _flags.debug_enabled = true;
     }
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
         _debug->print(F("Debug level: "));
         _debug->println(debug_level == DEBUG_LEVEL_DEFAULT ? "default" : "verbose");
@@ -132,14 +241,25 @@ void KWP2000::setDebugLevel(const uint8_t debug_level)
 /**
  * @brief Disable the debug
  */
-void KWP2000::disableDebug()
+void KWP2000Base::disableDebug()
 {
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
         _debug->println(F("Debug disabled"));
     }
     _debug->end();
-    _debug_enabled = false;
+    _flags.debug_enabled = false;
+}
+
+/**
+ * @brief Follow every byte and every timing window on the K-Line, e.g. to export a VCD file with `VCDWriter`. 
+ *          The callback is called inside the communication, it must be fast: keep the events and write them later
+ * 
+ * @param callback The function to call, `nullptr` to stop
+ */
+void KWP2000Base::setTraceCallback(trace_callback_t callback)
+{
+    _trace_callback = callback;
 }
 
 /**
@@ -147,7 +267,7 @@ void KWP2000::disableDebug()
  * 
  * @param dealer_pin The pin you will use to control it
  */
-void KWP2000::enableDealerMode(const uint8_t dealer_pin)
+void KWP2000Base::enableDealerMode(const uint8_t dealer_pin)
 {
     _dealer_pin = dealer_pin;
     pinMode(_dealer_pin, OUTPUT);
@@ -159,15 +279,149 @@ void KWP2000::enableDealerMode(const uint8_t dealer_pin)
  * 
  * @param dealer_mode Choose between true/false
  */
-void KWP2000::dealerMode(const uint8_t dealer_mode)
+void KWP2000Base::dealerMode(const uint8_t dealer_mode)
 {
-    _dealer_mode = dealer_mode;
-    digitalWrite(_dealer_pin, _dealer_mode);
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    _flags.dealer_mode = (dealer_mode != false);
+    digitalWrite(_dealer_pin, _flags.dealer_mode);
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
         _debug->print(F("Dealer mode: "));
-        _debug->println(_dealer_mode == true ? "Enabled" : "Disabled");
+        _debug->println(_flags.dealer_mode == true ? "Enabled" : "Disabled");
+    }
+}
+
+/**
+ * @brief Keep some data about the ECU across power cycles (its timing parameters, identification, learned 
+ *          throttle calibration and line config), this way `initKline()` and `readECUIdentification()` are faster when the same ECU is found again
+ * 
+ * @param read_function Function that reads `len` bytes from the `address` of the storage (e.g. the EEPROM) into `data`
+ * @param write_function Function that writes `len` bytes of `data` to the `address` of the storage
+ * @param address Optional, default to `0`. The first address used by the library
+ */
+void KWP2000Base::enableStorage(storage_read_t read_function, storage_write_t write_function, const uint16_t address)
+{
+    _storage_read = read_function;
+    _storage_write = write_function;
+    _storage_address = address;
+}
+
+/**
+ * @brief Change how a channel is calculated from the raw value sent by the ECU, e.g. for a different tyre or sensor. 
+ *          The calibration is folded in two integer constants, so it costs nothing when the sensors are decoded
+ * 
+ * @param channel One of the `sensor_channel` from `CH_SPEED`, the gear and the RPM can't be calibrated
+ * @param raw_low A raw value from the response
+ * @param value_low The value of `raw_low`, in the units of the channel (Celsius for the temperatures)
+ * @param raw_high Another raw value, higher than `raw_low`
+ * @param value_high The value of `raw_high`
+ */
+void KWP2000Base::setCalibration(const uint8_t channel, const uint8_t raw_low, const int16_t value_low, const uint8_t raw_high, const int16_t value_high)
+{
+    if (channel < CH_SPEED || channel >= CH_TOTAL || raw_low >= raw_high)
+    {
+        setError(EE_USER);
+        return;
+    }
+
+    calibration_t &calibration = _calibration[channel - CH_SPEED];
+    calibration.raw_low = raw_low;
+    calibration.raw_high = raw_high;
+    calibration.value_low = value_low;
+    calibration.value_high = value_high;
+    foldCalibration(channel);
+}
+
+/**
+ * @brief Go back to the calibration of the library for a channel
+ * 
+ * @param channel One of the `sensor_channel` from `CH_SPEED`
+ */
+void KWP2000Base::resetCalibration(const uint8_t channel)
+{
+    if (channel < CH_SPEED || channel >= CH_TOTAL)
+    {
+        setError(EE_USER);
+        return;
+    }
+
+    _calibration[channel - CH_SPEED] = default_calibration[channel - CH_SPEED];
+    foldCalibration(channel);
+}
+
+/**
+ * @brief Learn the calibration of the TPS and of the STPS: the lowest raw value seen (idle) is 0% and 
+ *          the highest (WOT) is 100%, open the throttle fully once. The library calibration is used until they are 
+ *          `KWP2000_THROTTLE_SPAN` apart. With the storage (see `enableStorage()`) the calibration is kept for each bike, 
+ *          recognized by `readECUIdentification()`
+ * 
+ * @param enable Optional, default to `true`. `false` stops learning and keeps the calibration learned
+ */
+void KWP2000Base::learnThrottle(const uint8_t enable)
+{
+    if (enable == true && _flags.throttle_learning == false)
+    {
+        // nothing seen yet
+        const calibration_t empty = {255, 0, 0, 100};
+        _calibration[CH_TPS - CH_SPEED] = empty;
+        _calibration[CH_STPS - CH_SPEED] = empty;
+    }
+    _flags.throttle_learning = enable;
+}
+
+/**
+ * @brief Choose the units of the temperatures (IAT and ECT), it changes only their calibration constants
+ * 
+ * @param unit One of the `temperature_unit`
+ */
+void KWP2000Base::setTemperatureUnit(const uint8_t unit)
+{
+    _flags.fahrenheit = unit == UNIT_FAHRENHEIT;
+    foldCalibration(CH_IAT);
+    foldCalibration(CH_ECT);
+}
+
+/**
+ * @brief Search the baudrate and the parity of the ECU: every `initKline()` tries the next line config with a single 
+ *          start communication and a P2 max timeout. The one that worked is kept in the storage and tried first next time
+ * 
+ * @param candidates Optional, the line configs to try in order. Without them `10400` and `9600` baud with the usual parities
+ * @param candidates_len The lenght of `candidates`
+ */
+void KWP2000Base::enableAutoBaud(const line_config_t candidates[], const uint8_t candidates_len)
+{
+    if (candidates == nullptr)
+    {
+        _line_candidates = default_line_candidates;
+        _line_candidates_len = LEN(default_line_candidates);
+    }
+    else
+    {
+        _line_candidates = candidates;
+        _line_candidates_len = candidates_len;
     }
+    _line_next = 0;
+    _flags.auto_baud = true;
+}
+
+/**
+ * @brief Go back to the baudrate of the constructor, with odd parity
+ */
+void KWP2000Base::disableAutoBaud()
+{
+    _flags.auto_baud = false;
+    _kline_baudrate = _line_default.baudrate;
+    _kline_config = _line_default.config;
+}
+
+/**
+ * @brief Set the algorithm used by `securityAccess()` to calculate the key from the seed sent by the ECU
+ * 
+ * @param key_function The function that calculates the key, see `security_key_t`
+ */
+void KWP2000Base::setSecurityKey(security_key_t key_function)
+{
+    _security_key = key_function;
+    _security_level = 0;
 }
 
 ////////////// COMMUNICATION - Basic ////////////////
@@ -177,22 +431,29 @@ void KWP2000::dealerMode(const uint8_t dealer_mode)
  * 
  * @return `0` until the connection is not established, then `true` if there aren't any errors, a `negative number` otherwise
  */
-int8_t KWP2000::initKline()
+int8_t KWP2000Base::initKline()
 {
-    if (_ECU_status == true)
+    if (_flags.ECU_status == true)
     {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
         {
             _debug->println(F("\nAlready connected"));
         }
         return 1;
     }
 
-    if (_init_sequence_started == false)
+    if (_flags.sniffing == true)
+    {
+        // the sniffer never transmits
+        setError(EE_USER);
+        return -1;
+    }
+
+    if (_flags.init_sequence_started == false)
     {
-        _init_sequence_started = true;
+        _flags.init_sequence_started = true;
 
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
         {
             _debug->println(F("\nInitialize K-line"));
         }
@@ -207,33 +468,42 @@ int8_t KWP2000::initKline()
             // after the connection has been lost due to time out of P3
             ISO_T_IDLE = 100; // should be 0
         }
+        else if (_flags.auto_baud == true && bitRead(_ECU_error, EE_START) == 1)
+        {
+            // the previous line config didn't work, the next one is tried soon
+            ISO_T_IDLE = ISO_T_IDLE_MIN;
+        }
         else
         {
             // after a stopKline
             ISO_T_IDLE = ISO_T_P3_MAX;
         }
 
-        _use_lenght_byte = false;
-        _use_target_source_address = true;
+        _link.length_byte = false;
+        _link.addresses = true;
+        updateLayout();
         //_kline->end();
         pinMode(_k_out_pin, OUTPUT);
         digitalWrite(_k_out_pin, LOW);
+        TRACE(TRACE_K_OUT, LOW);
 
-        _start_time = millis();
+        _start_time = KWP2000_MILLIS();
         _elapsed_time = 0;
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("Starting sequence"));
         }
     }
-    _elapsed_time = millis() - _start_time;
+    _elapsed_time = KWP2000_MILLIS() - _start_time;
 
     if (_elapsed_time < ISO_T_IDLE)
     {
         if (digitalRead(_k_out_pin) != HIGH)
         {
             digitalWrite(_k_out_pin, HIGH);
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            TRACE(TRACE_K_OUT, HIGH);
+            TRACE(TRACE_INIT, 0);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->print(F("T0:\t"));
                 _debug->println(_elapsed_time);
@@ -246,7 +516,9 @@ int8_t KWP2000::initKline()
         if (digitalRead(_k_out_pin) != LOW)
         {
             digitalWrite(_k_out_pin, LOW);
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            TRACE(TRACE_K_OUT, LOW);
+            TRACE(TRACE_INIT, 1);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->print(F("T1:\t"));
                 _debug->println(_elapsed_time);
@@ -259,7 +531,9 @@ int8_t KWP2000::initKline()
         if (digitalRead(_k_out_pin) != HIGH)
         {
             digitalWrite(_k_out_pin, HIGH);
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            TRACE(TRACE_K_OUT, HIGH);
+            TRACE(TRACE_INIT, 2);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->print(F("T2:\t"));
                 _debug->println(_elapsed_time);
@@ -269,42 +543,108 @@ int8_t KWP2000::initKline()
     }
     else if (_elapsed_time >= (ISO_T_IDLE + ISO_T_WUP))
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        TRACE(TRACE_INIT, 3);
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("T3:\t"));
             _debug->println(_elapsed_time);
             _debug->println(F("\nSending the start sequence"));
         }
-        _init_sequence_started = false;
+        _flags.init_sequence_started = false;
 
         _start_time = 0;
         _elapsed_time = 0;
-        _kline->begin(_kline_baudrate, SERIAL_8O1);
+        if (_flags.auto_baud == true && _line_next == 0)
+        {
+            selectLineConfig(); // a new round, from the stored one
+        }
+        _kline->begin(_kline_baudrate, _kline_config);
+
+        int8_t started;
+        if (_flags.auto_baud == true)
+        {
+            // with the wrong line config the ECU is silent or sends garbage, waiting more is useless
+            started = sendRequest(start_com, LEN(start_com));
+            if (started == true)
+            {
+                listenResponse(true, ISO_T_P2_MAX + ISO_T_P4_MAX_LIMIT);
+                started = checkResponse(start_com);
+            }
+        }
+        else
+        {
+            started = handleRequest(start_com, LEN(start_com));
+        }
 
-        if (handleRequest(start_com, LEN(start_com)) == true)
+        if (started == true)
         {
-            if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+            if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
             {
                 _debug->println(F("ECU connected"));
             }
-            _connection_time = millis();
-            _ECU_status = true;
+            _connection_time = KWP2000_MILLIS();
+            _flags.ECU_status = true;
             _ECU_error = 0;
             configureKline();
+            loadCalibration();
+
+            if (_flags.auto_baud == true)
+            {
+                if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+                {
+                    _debug->print(F("Line config found:\t"));
+                    _debug->print(_kline_baudrate);
+                    _debug->print(F(" baud, config 0x"));
+                    _debug->println(_kline_config, HEX);
+                }
+                line_config_t stored;
+                if (loadRecord(STORAGE_LINE, (uint8_t *)&stored, sizeof(stored)) == false ||
+                    stored.baudrate != _kline_baudrate || stored.config != _kline_config)
+                {
+                    const line_config_t found = {_kline_baudrate, _kline_config};
+                    saveRecord(STORAGE_LINE, (const uint8_t *)&found, sizeof(found));
+                }
+                _line_next = 0; // the next connection starts from this one
+            }
+
+            link_record stored;
+            if (loadRecord(STORAGE_LINK, (uint8_t *)&stored, sizeof(stored)) == true && stored.key_bytes == _key_bytes)
+            {
+                // same ECU as last time, we already know its timing parameters
+                if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+                {
+                    _debug->println(F("Timing parameters from the storage"));
+                }
+                timingParameter(stored.atp, false);
+                return 1; // end of the init sequence
+            }
         }
         else
         {
-            if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+            if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
             {
                 _debug->println(F("Initialization failed"));
             }
-            _ECU_status = false;
-            ISO_T_IDLE = 0;
+            _flags.ECU_status = false;
+            if (_flags.auto_baud == true && selectLineConfig() == true)
+            {
+                if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+                {
+                    _debug->print(F("Next line config:\t"));
+                    _debug->println(_kline_baudrate);
+                }
+            }
+            else
+            {
+                // all of them failed, the next round starts after the full idle
+                ISO_T_IDLE = 0;
+                _line_next = 0;
+            }
             setError(EE_START);
             return -2;
         }
 
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("Reading timing limits"));
         }
@@ -314,13 +654,13 @@ int8_t KWP2000::initKline()
         }
         else
         {
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Error reading limits ATP"));
             }
         }
 
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("Reading current timing paramenters"));
         }
@@ -328,11 +668,19 @@ int8_t KWP2000::initKline()
         if (handleRequest(atp_read_current, LEN(atp_read_current)) == true)
         {
             accessTimingParameter(false);
+
+            link_record to_store;
+            to_store.key_bytes = _key_bytes;
+            for (uint8_t n = 0; n < 5; n++)
+            {
+                to_store.atp[n] = _response[_response_data_start + 2 + n];
+            }
+            saveRecord(STORAGE_LINK, (const uint8_t *)&to_store, sizeof(to_store));
             return 1; // end of the init sequence
         }
         else
         {
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Error reading current ATP"));
             }
@@ -350,22 +698,22 @@ int8_t KWP2000::initKline()
  * 
  * @return `0` until the connection is not closed, then `true` if there aren't any errors, a `negative number` otherwise
  */
-int8_t KWP2000::stopKline()
+int8_t KWP2000Base::stopKline()
 {
-    if (_ECU_status == false)
+    if (_flags.ECU_status == false)
     {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
         {
             _debug->println(F("\nAlready disconnected"));
         }
         return 1;
     }
 
-    if (_stop_sequence_started == false)
+    if (_flags.stop_sequence_started == false)
     {
-        _stop_sequence_started = true;
+        _flags.stop_sequence_started = true;
 
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("Closing K-line"));
         }
@@ -382,14 +730,21 @@ int8_t KWP2000::stopKline()
         }
 
         // reset all
-        for (uint16_t i = 0; i < ISO_MAX_DATA; i++)
+        for (uint16_t i = 0; i < _response_size; i++)
         {
             _response[i] = 0;
         }
         _response_len = 0;
         _response_data_start = 0;
+        _frames_count = 0;
 
+        saveCalibration();
+        _flags.id_valid = false;
+        _flags.silent_keep_alive = maybe;
+        _security_level = 0;
         _last_correct_response = 0;
+        _silent_keep_alives = 0;
+        _last_keep_alive_call = 0;
         _last_data_print = 0;
         _last_sensors_calculated = 0;
         _last_status_print = 0;
@@ -398,11 +753,11 @@ int8_t KWP2000::stopKline()
         _kline->end();
 
         _ECU_error = 0;
-        _start_time = millis();
+        _start_time = KWP2000_MILLIS();
         _elapsed_time = 0;
     }
 
-    _elapsed_time = millis() - _start_time;
+    _elapsed_time = KWP2000_MILLIS() - _start_time;
 
     if (_elapsed_time < ISO_T_P3_MAX)
     {
@@ -410,14 +765,14 @@ int8_t KWP2000::stopKline()
     }
     else
     {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
         {
             _debug->println(F("ECU disconnected"));
         }
-        _ECU_status = false;
+        _flags.ECU_status = false;
         _start_time = 0;
         _elapsed_time = 0;
-        _stop_sequence_started = false;
+        _flags.stop_sequence_started = false;
         return 1;
     }
 }
@@ -425,11 +780,11 @@ int8_t KWP2000::stopKline()
 /**
  * @brief Send a request to the ECU asking for data from all the sensors, to see them you can use `printSensorsData()`
  */
-void KWP2000::requestSensorsData()
+void KWP2000Base::requestSensorsData()
 {
-    if (_ECU_status == false)
+    if (_flags.ECU_status == false)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("Not connected to the ECU"));
         }
@@ -437,57 +792,20 @@ void KWP2000::requestSensorsData()
         return;
     }
 
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
         _debug->println(F("Requesting Sensors Data"));
     }
+    _last_sensors_request = KWP2000_MILLIS();
 
 #if defined(SUZUKI)
 
     handleRequest(request_sens, LEN(request_sens));
-    //GPS (Gear Position Sensor)
-    _GEAR1 = _response[PID_GPS];
-    _GEAR2 = _response[PID_CLUTCH];
-    _GEAR3 = _response[PID_GEAR_3];
-    _GPS = 0;
-
-    //RPM (Rights Per Minutes) it is split between two byte
-    _RPM = _response[PID_RPM_H] * 10 + _response[PID_RPM_L] / 10;
-
-    //Speed
-    _SPEED = _response[PID_SPEED] * 2;
-
-    //TPS (Throttle Position Sensor)
-    _TPS = 125 * (_response[PID_TPS] - 55) / (256 - 55);
-
-    //IAP (Intake Air Pressure)
-    _IAP = _response[PID_IAP] * 4 * 0.136;
-
-    //IAT (Intake Air Temperature)
-    _IAT = (_response[PID_IAT] - 48) / 1.6;
-
-    //ECT (Engine Coolant Temperature)
-    _ECT = (_response[PID_ECT] - 48) / 1.6;
-
-    //STPS (Secondary Throttle Position Sensor)
-    _STPS = _response[PID_STPS] / 2.55;
-
-    /*
-    other sensors
-
-    //voltage?
-    voltage = _response[32] * 100 / 126;
-
-    //FUEL 40-46
-
-    //IGN 49-52
-
-    //STVA
-    STVA = _response[54] * 100 / 255;
-
-    //pair
-    PAIR = _response[59];
-    */
+    if (_response_len <= PID_GEAR_3)
+    {
+        // the frame is incomplete or the response buffer is too small for it
+        return;
+    }
 
 #elif defined(KAWASAKI)
 
@@ -507,46 +825,109 @@ void KWP2000::requestSensorsData()
 
 #endif
 
-#ifdef FAHRENHEIT // convert the temperature values to fahrenheit
-    _IAT = TO_FAHRENHEIT(_IAT);
-    _ECT = TO_FAHRENHEIT(_ECT);
-#endif
-
-    _last_sensors_calculated = millis();
+    decodeSensors();
 }
 
 /**
- * @brief Read the Diagnostic Trouble Codes (DTC) from the ECU
+ * @brief Read the Diagnostic Trouble Codes (DTC) from the ECU and keep them, see `getTroubleCode()`
  * 
  * @param which Optional, default to `READ_ONLY_ACTIVE`. One of the values from the `trouble_codes` enum
+ * @return `true` if the DTC have been read, a `negative number` otherwise
  */
-void KWP2000::readTroubleCodes(const uint8_t which)
+int8_t KWP2000Base::readTroubleCodes(const uint8_t which)
 {
+    int8_t result = -1;
+
     if (which == READ_TOTAL)
     {
-        handleRequest(trouble_codes_all, LEN(trouble_codes_all));
+        result = handleRequest(trouble_codes_all, LEN(trouble_codes_all));
     }
     else if (which == READ_ONLY_ACTIVE)
     {
-        handleRequest(trouble_codes_only_active, LEN(trouble_codes_only_active));
+        result = handleRequest(trouble_codes_only_active, LEN(trouble_codes_only_active));
     }
     else if (which == READ_ALL)
     {
-        handleRequest(trouble_codes_with_status, LEN(trouble_codes_with_status));
+        result = handleRequest(trouble_codes_with_status, LEN(trouble_codes_with_status));
+    }
+    else
+    {
+        setError(EE_USER);
+    }
+
+    if (result != true)
+    {
+        return result;
+    }
+
+    listenTroubleCodes();
+    parseTroubleCodes();
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        printTroubleCodes();
+    }
+    return true;
+}
+
+/**
+ * @brief Read the DTC again and tell if they changed, without printing them. The DTC of all groups are asked by status, 
+ *          if the ECU doesn't support this request they are read with the plain `0x18` of `readTroubleCodes()`.
+ *          KWP2000 has no request for the number of DTC alone: every poll transfers the whole list, 
+ *          which takes more than one response when the ECU has many DTC
+ * 
+ * @return `true` if the DTC changed, `false` if they are the same, a `negative number` otherwise
+ */
+int8_t KWP2000Base::pollTroubleCodes()
+{
+    if (_flags.ECU_status == false)
+    {
+        setError(EE_USER);
+        return -1;
     }
 
-    const uint8_t DTC_total = _response[_response_data_start + 1]; // Diagnosis trouble codes
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    if (_flags.dtc_by_status != false)
     {
-        _debug->print("There are ");
-        _debug->print(DTC_total);
-        _debug->println(" errors\n");
-        for (uint8_t n = _response_data_start + 2; n < _response_len; n++)
+        if (handleRequest(trouble_codes_by_status, LEN(trouble_codes_by_status), true) == true)
         {
-            _debug->print(_response[n]); // todo needed more test to understand the DTC number, value and status parameters
+            _flags.dtc_by_status = true;
+            listenTroubleCodes();
+            return parseTroubleCodes();
         }
-        _debug->println();
+        else if (_last_nrc == 0x11 || _last_nrc == 0x12 || _last_nrc == 0x31)
+        {
+            // not supported, from now on we read all the DTC
+            _flags.dtc_by_status = false;
+        }
+        else
+        {
+            return -2; // busy or no answer, next time we try again
+        }
+    }
+
+    if (handleRequest(trouble_codes_with_status, LEN(trouble_codes_with_status)) != true)
+    {
+        return -3;
     }
+    listenTroubleCodes();
+    return parseTroubleCodes();
+}
+
+/**
+ * @brief Let `update()` check the DTC in the gaps between the sensors requests, 
+ *          the callback is called for every new or cleared DTC. The DTC found by the first read are not reported, 
+ *          they are already there: see `getTroubleCode()`. After `clearTroubleCodes()` they are checked at once
+ * 
+ * @param interval Time between two checks in milliseconds, `0` stops the monitor
+ * @param max_bus_share Optional, default to `5`. Maximum percentage of the time spent checking the DTC
+ * @param callback Optional. Function called with the DTC and `true` if it appeared or `false` if it has been cleared
+ */
+void KWP2000Base::monitorTroubleCodes(const uint16_t interval, const uint8_t max_bus_share, dtc_callback_t callback)
+{
+    _dtc_interval = interval;
+    _dtc_max_share = max_bus_share > 100 ? 100 : max_bus_share;
+    _dtc_callback = callback;
+    _dtc_bus_time = 0;
+    _dtc_window_start = KWP2000_MILLIS();
 }
 
 /**
@@ -554,7 +935,7 @@ void KWP2000::readTroubleCodes(const uint8_t which)
  * 
  * @param code Optional. Only the passed `code` will be cleared
  */
-void KWP2000::clearTroubleCodes(const uint8_t code)
+void KWP2000Base::clearTroubleCodes(const uint8_t code)
 {
     if (code == 0x00) // Clear all
     {
@@ -565,805 +946,2855 @@ void KWP2000::clearTroubleCodes(const uint8_t code)
         const uint8_t to_clear[] = {clear_trouble_codes[0], code};
         handleRequest(to_clear, LEN(to_clear));
     }
+    _flags.dtc_stale = true; // the list is kept, the next read tells which DTC have been cleared
 }
 
 /**
- * @brief Keep the connection through the K-Line alive
+ * @brief Ask the ECU who it is (service 0x1A), the identification is read once for each connection. 
+ *          With `enableStorage()` only the VIN is asked to an ECU we already know
  * 
- * @param time Optional. It is calculated automatically to be a safe interval
+ * @param force Optional, default to `false`. Read again all the identification from the ECU
+ * @return `true` if at least one field has been read, a `negative number` otherwise
  */
-void KWP2000::keepAlive(uint16_t time)
+int8_t KWP2000Base::readECUIdentification(const uint8_t force)
 {
-    if (_kline->available() > 0)
+    if (_flags.ECU_status == false)
     {
-        // the ECU wants to tell something
-        uint8_t in;
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println("Me:\nHave you said something?\nECU:");
-        }
-        while (_kline->available() > 0)
-        {
-            in = _kline->read();
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
-            {
-                _debug->println(in, HEX);
-            }
-        }
+        setError(EE_USER);
+        return -1;
     }
 
-    if (_ECU_status == false)
+    if (_flags.id_valid == true && force == false)
     {
-        return; //if it is not connected it is meaningless to send a request
+        return true;
     }
 
-    if (millis() - _last_correct_response >= ISO_T_P3_MAX)
+    ecu_id_t stored;
+    if (force == false && loadRecord(STORAGE_ID, (uint8_t *)&stored, sizeof(stored)) == true && stored.vin[0] != 0)
     {
-        // the connection has been lost
-        if (_stop_sequence_started == false)
+        memset(&_ecu_id, 0, sizeof(_ecu_id));
+        if (readIdentificationOption(id_vin) == true && strcmp(_ecu_id.vin, stored.vin) == 0)
         {
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
-                _debug->println(F("\nConnection expired"));
+                _debug->println(F("Known ECU, identification from the storage"));
             }
-            _ECU_status = false;
-            _last_data_print = 0;
-            _last_sensors_calculated = 0;
-            _last_status_print = 0;
-            _connection_time = 0;
-            _kline->end();
-            setError(EE_P3MAX);
+            _ecu_id = stored;
+            _flags.id_valid = true;
+            loadCalibration();
+            return true;
         }
-        return;
     }
 
-    if (time == 0)
+    const uint8_t options[] = {id_vin, id_part_number, id_hardware_number, id_software_number, id_system_name};
+    uint8_t found = 0;
+
+    memset(&_ecu_id, 0, sizeof(_ecu_id));
+    for (uint8_t i = 0; i < LEN(options); i++)
     {
-        time = _keep_iso_alive;
+        if (readIdentificationOption(options[i]) == true)
+        {
+            found++;
+        }
     }
 
-    if (time > ISO_T_P3_MAX)
+    if (found == 0)
     {
-        // prevent human's errors
-        time = _keep_iso_alive;
-        setError(EE_USER);
+        return -2;
     }
 
-    if (millis() - _last_correct_response <= time)
+    // FNV-1a hash of all the fields
+    _ecu_id.fingerprint = 2166136261UL;
+    const uint8_t *field = (const uint8_t *)&_ecu_id;
+    for (uint16_t n = 0; n < offsetof(ecu_id_t, fingerprint); n++)
     {
-        // not enough time has passed since last time we talked with the ECU
-        return;
+        _ecu_id.fingerprint = (_ecu_id.fingerprint ^ field[n]) * 16777619UL;
     }
+    _flags.id_valid = true;
+    saveRecord(STORAGE_ID, (const uint8_t *)&_ecu_id, sizeof(_ecu_id));
+    loadCalibration();
 
-    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
-        _debug->print(F("\nKeeping connection alive\nLast:"));
-        _debug->println(millis() - _last_correct_response);
+        _debug->print(F("VIN:\t\t"));
+        _debug->println(_ecu_id.vin);
+        _debug->print(F("Part number:\t"));
+        _debug->println(_ecu_id.part_number);
+        _debug->print(F("Hardware:\t"));
+        _debug->println(_ecu_id.hardware_number);
+        _debug->print(F("Software:\t"));
+        _debug->println(_ecu_id.software_number);
+        _debug->print(F("System:\t\t"));
+        _debug->println(_ecu_id.system_name);
+        _debug->print(F("Fingerprint:\t"));
+        _debug->println(_ecu_id.fingerprint, HEX);
     }
-#if defined(SUZUKI)
-    handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
-#elif defined(KAWASAKI)
-    handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
-#elif defined(YAMAYA)
-    handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
-#elif defined(HONDA)
-    handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
-#endif
+    return true;
 }
 
-////////////// COMMUNICATION - Advanced ////////////////
 /**
- * @brief This function is the core of the library. You just need to give a PID and it will generate the header, calculate the checksum and try to send the request. 
- *          Then it will check if the response is correct and if now it will try to send the request another two times, all is based on the ISO14230
+ * @brief Unlock the services protected by the ECU with the seed and key handshake (service 0x27). 
+ *          The unlocked level is kept until the end of the connection, so calling it again doesn't touch the bus
  * 
- * @param to_send The PID you want to send, see PID.h for more detail
- * @param send_len The lenght of the PID (use `sizeof` to get it)
- * @param try_once Optional, default to `false`. Choose if you want to try to send the request 3 times in case of error
- * @return `true` if the request has been sent and a correct response has been received, a `negative number` otherwise
+ * @param level Optional, default to `0x01`. The odd value used to request the seed, the key is sent with `level + 1`
+ * @return `true` if the ECU is unlocked, `-3` while the ECU asks to wait before a new attempt, 
+ *          `-4` if the key is wrong or can't be calculated, a `negative number` for the other errors
  */
-int8_t KWP2000::handleRequest(const uint8_t to_send[], const uint8_t send_len, const uint8_t try_once)
+int8_t KWP2000Base::securityAccess(const uint8_t level)
 {
-    uint8_t attempt;
-    uint8_t completed = false;
+    if (_flags.ECU_status == false || (level & 0x01) == 0 || _security_key == nullptr)
+    {
+        setError(EE_USER);
+        return -1;
+    }
 
-    if (try_once == true)
+    if (_security_level == level)
     {
-        attempt = 3;
+        return true;
     }
-    else
+
+    if (_security_delay_end != 0 && (int32_t)(KWP2000_MILLIS() - _security_delay_end) < 0)
+    {
+        // requiredTimeDelayNotExpired: another attempt would only restart the delay
+        return -3;
+    }
+    _security_delay_end = 0;
+
+    const uint8_t request_seed[] = {security_access[0], level};
+    if (handleRequest(request_seed, LEN(request_seed), true) != true)
     {
-        attempt = 1;
+        return securityRejected();
     }
 
-    while (attempt <= 3 && completed == false)
+    uint8_t seed[KWP2000_MAX_KEY];
+    uint8_t seed_len = 0;
+    uint8_t seed_is_zero = true;
+    for (uint16_t n = _response_data_start + 2; n < _response_len && seed_len < KWP2000_MAX_KEY; n++)
     {
-        sendRequest(to_send, send_len);
-        listenResponse();
-        if (checkResponse(to_send) == true)
+        seed[seed_len] = _response[n];
+        if (seed[seed_len] != 0)
         {
-            completed = true;
+            seed_is_zero = false;
         }
-        else
+        seed_len++;
+    }
+
+    if (seed_is_zero == false)
+    {
+        // we use the space after the SID and the level for the key
+        uint8_t send_key[2 + KWP2000_MAX_KEY] = {security_access[0], (uint8_t)(level + 1)};
+        const uint8_t key_len = _security_key(level, seed, seed_len, &send_key[2], KWP2000_MAX_KEY);
+        if (key_len == 0 || key_len > KWP2000_MAX_KEY)
         {
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
             {
-                _debug->print(F("Attempt "));
-                _debug->print(attempt);
-                _debug->print(F(" not luckly"));
-                _debug->println(attempt < 3 ? ", trying again"
-                                            : "\nWe wasn't able to comunicate");
+                _debug->println(F("Unable to calculate the key"));
             }
-            attempt++;
+            return -4;
         }
-    }
 
-    if (completed == true)
-    {
-        return true;
+        if (handleRequest(send_key, 2 + key_len, true) != true)
+        {
+            return securityRejected();
+        }
     }
-    else
+    // a seed of zeros means that the level is already unlocked
+
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
     {
-        // we made more than 3 attemps so there is a problem
-        return -1;
+        _debug->print(F("Security access granted, level "));
+        _debug->println(level, HEX);
     }
+    _security_level = level;
+    return true;
 }
 
 /**
- * @brief Ask and print the Timing Parameters from the ECU
+ * @brief Keep the connection through the K-Line alive
  * 
- * @param read_only Optional, default to `true`. This avoid the possibility to unintentionally change them
+ * @param time Optional. It is calculated automatically to be a safe interval
  */
-void KWP2000::accessTimingParameter(const uint8_t read_only)
+void KWP2000Base::keepAlive(uint16_t time)
 {
-    uint8_t p2_min_temp = _response[_response_data_start + 2];
-    uint16_t p3_min_temp = _response[_response_data_start + 4];
-    uint16_t p4_min_temp = _response[_response_data_start + 6];
-
-    uint32_t p2_max_temp = _response[_response_data_start + 3];
-    if (p2_max_temp <= 0xF0)
+    if (_kline->available() > 0)
     {
-        p2_max_temp *= 25;
+        // the ECU wants to tell something
+        uint8_t in;
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println("Me:\nHave you said something?\nECU:");
+        }
+        while (_kline->available() > 0)
+        {
+            in = _kline->read();
+            _last_byte_received = KWP2000_MILLIS();
+            TRACE(TRACE_RX, in);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(in, HEX);
+            }
+        }
     }
-    else if ((p2_max_temp > 0xF0) && (p2_max_temp < 0xFF))
+
+    if (_flags.ECU_status == false)
     {
-        p2_max_temp = (p2_max_temp & 0xF) * 256 * 25;
+        return; //if it is not connected it is meaningless to send a request
     }
-    else if (p2_max_temp == 0xFF)
+
+    const uint32_t now = KWP2000_MILLIS();
+    if (_last_keep_alive_call != 0)
     {
-        p2_max_temp = 89601;
-        setError(EE_ATP);
+        // how late can be the next call, requests included: it is the margin we need before P3 max
+        const uint32_t gap = now - _last_keep_alive_call;
+        if (gap > _loop_gap)
+        {
+            _loop_gap = gap > ISO_T_P3_MAX / 2 ? ISO_T_P3_MAX / 2 : gap;
+        }
+        else
+        {
+            _loop_gap -= (_loop_gap - gap) / 16; // slowly forget the slow loops
+        }
     }
+    _last_keep_alive_call = now;
 
-    uint32_t p3_max_temp = _response[_response_data_start + 5];
-    if (p3_max_temp <= 0xF0)
+    // only a response proves that the ECU is there, each silent tester present gives it one more P3 max to answer
+    const uint32_t last_answer = _last_correct_response;
+    if (now - last_answer >= ISO_T_P3_MAX * (1 + (uint32_t)_silent_keep_alives))
     {
-        p3_max_temp *= 25;
+        // the connection has been lost
+        if (_flags.stop_sequence_started == false)
+        {
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(F("\nConnection expired"));
+            }
+            _flags.ECU_status = false;
+            saveCalibration();
+            _flags.id_valid = false;
+            _flags.silent_keep_alive = maybe;
+            _silent_keep_alives = 0;
+            _security_level = 0;
+            _last_data_print = 0;
+            _last_sensors_calculated = 0;
+            _last_status_print = 0;
+            _connection_time = 0;
+            _last_keep_alive_call = 0;
+            _kline->end();
+            _scheduler_stats.expired++;
+            setError(EE_P3MAX);
+        }
+        return;
     }
-    else if ((p3_max_temp > 0xF0) && (p3_max_temp < 0xFF))
+
+    // P3 restarts with every request we send and every response of the ECU
+    const uint32_t last_activity = (int32_t)(_last_request_sent - last_answer) > 0 ? _last_request_sent : last_answer;
+
+    if (time == 0)
     {
-        p3_max_temp = (p3_max_temp & 0xF) * 256 * 25;
+        // as late as possible: a slow loop or a response that takes P2 max must still be in time
+        time = ISO_T_P3_MAX - ISO_T_P3_MAX / 8;
+        const uint32_t margin = _loop_gap + ISO_T_P2_MAX;
+        if (margin < ISO_T_P3_MAX / 2)
+        {
+            time = ISO_T_P3_MAX - margin < time ? ISO_T_P3_MAX - margin : time;
+        }
+        else
+        {
+            time = ISO_T_P3_MAX / 2;
+        }
     }
-    else if (p3_max_temp == 0xFF)
+
+    if (time > ISO_T_P3_MAX)
     {
-        p3_max_temp = 89601;
-        setError(EE_ATP);
+        // prevent human's errors
+        time = ISO_T_P3_MAX / 2;
+        setError(EE_USER);
     }
 
-    // any of these condition is an error
-    if ((p2_min_temp > p2_max_temp) || (p3_min_temp > p3_max_temp) || (p4_min_temp > ISO_T_P4_MAX_LIMIT) || (p3_min_temp < p4_min_temp))
+    if (now - last_activity <= time)
     {
-        setError(EE_ATP);
+        // not enough time has passed since last time we talked with the ECU
+        return;
     }
 
-    if (read_only == false)
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
     {
-        ISO_T_P2_MIN = p2_min_temp;
-        ISO_T_P2_MAX = p2_max_temp;
-        ISO_T_P3_MIN = p3_min_temp;
-        ISO_T_P3_MAX = p3_max_temp;
-        ISO_T_P4_MIN = p4_min_temp;
-
-        // we set a safe margin to ask data enough often to the ECU
-        _keep_iso_alive = p3_max_temp / 4;
+        _debug->print(F("\nKeeping connection alive\nLast:"));
+        _debug->println(now - last_activity);
     }
 
-    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+    if (_flags.silent_keep_alive == false || _silent_keep_alives >= KWP2000_SILENT_KEEP_ALIVES)
     {
-        _debug->println(F("Timing Parameter from the ECU:"));
-        _debug->print("Errors:\t");
-        _debug->println(bitRead(_ECU_error, EE_ATP) == 1 ? "Yes" : "No");
-        _debug->print(F("P2 min:\t"));
-        _debug->println(p2_min_temp);
-        _debug->print(F("P2 max:\t"));
-        _debug->println(p2_max_temp);
-        _debug->print(F("P3 min:\t"));
-        _debug->println(p3_min_temp);
-        _debug->print(F("P3 max:\t"));
-        _debug->println(p3_max_temp);
-        _debug->print(F("P4 min:\t"));
-        _debug->println(p4_min_temp);
-        _debug->println();
+        // without an answer the connection expires at the next call
+        handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
+        return;
     }
-}
 
-/**
- * @brief Reset the Timing Parameters to the default settings from the ECU
- */
-void KWP2000::resetTimingParameter()
-{
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+    // the ECU won't answer, so it is half the bus time of a request with answer
+    if (sendRequest(tester_present_without_answer, LEN(tester_present_without_answer)) != true)
     {
-        _debug->println(F("Resetting time parameters to default"));
+        return; // the bus was busy, the next call will try again
     }
-    if (handleRequest(atp_set_default, LEN(atp_set_default)) == true)
+
+    if (_flags.silent_keep_alive == maybe)
     {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        // if it is not supported the ECU rejects it within P2 max
+        const uint32_t sent = KWP2000_MILLIS();
+        while (_kline->available() == 0 && KWP2000_MILLIS() - sent < ISO_T_P2_MAX)
         {
-            _debug->println(F("Changed"));
         }
-    }
-    else
-    {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+
+        if (_kline->available() > 0)
         {
-            _debug->println(F("Not changed"));
+            listenResponse();
+            if (checkResponse(tester_present_without_answer) != true)
+            {
+                if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+                {
+                    _debug->println(F("Tester present without answer not supported"));
+                }
+                _flags.silent_keep_alive = false;
+                handleRequest(tester_present_with_answer, LEN(tester_present_with_answer));
+                return;
+            }
+        }
+        else
+        {
+            // nothing is also the answer of a dead ECU: it is supported only if the ECU is still there
+            if (handleRequest(tester_present_with_answer, LEN(tester_present_with_answer)) == true)
+            {
+                _flags.silent_keep_alive = true;
+            }
+            return;
         }
+        _flags.silent_keep_alive = true;
     }
-    accessTimingParameter(true);
+
+    // sent without collisions
+    _silent_keep_alives++;
 }
 
 /**
- * @brief Change the Timing Parameters to custom ones
+ * @brief Choose how often `update()` asks for the sensors data
  * 
- * @param new_atp Array of 5 elements containing the new parameters
- * @param new_atp_len The lenght of the array (use `sizeof` to get it)
+ * @param interval Time between two requests in milliseconds, `0` if you call `requestSensorsData()` by yourself
  */
-void KWP2000::changeTimingParameter(uint32_t new_atp[], const uint8_t new_atp_len)
+void KWP2000Base::setSensorsInterval(const uint16_t interval)
 {
-    if (_debug_level >= DEBUG_LEVEL_DEFAULT)
-    {
-        _debug->println(F("Changing timing parameter"));
-    }
+    _sensors_interval = interval;
+}
 
-    if (new_atp_len != 5)
+/**
+ * @brief Give the gear ratios of the bike, used to infer the gear when the ECU doesn't send its position. 
+ *          Without them they are learned while riding, which needs all the gears to be used at a steady speed
+ * 
+ * @param ratios The RPM at 100 km/h of each gear, from the first, `nullptr` to learn them again
+ * @param gears The number of ratios, at most `KWP2000_MAX_GEAR`
+ */
+void KWP2000Base::setGearRatios(const uint16_t ratios[], const uint8_t gears)
+{
+    _gear_ratios = ratios == nullptr ? 0 : gears > KWP2000_MAX_GEAR ? KWP2000_MAX_GEAR : gears;
+    for (uint8_t g = 0; g < _gear_ratios; g++)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("The time paramenter should be an array of 5 elements"));
-        }
-        setError(EE_USER);
-        return;
+        _gear_ratio[g] = ratios[g];
     }
+    _flags.gear_learning = _gear_ratios == 0;
+    _gear_pending_count = 0;
+}
 
-    if (new_atp[0] > ISO_T_P2_MIN_LIMIT)
+/**
+ * @brief Get the gear ratios given, learned while riding or measured with the gear position, e.g. to save them
+ * 
+ * @param ratios Where the RPM at 100 km/h of each gear will be written, from the first, 
+ *          it must have room for `KWP2000_MAX_GEAR` values
+ * @return The number of ratios known
+ */
+uint8_t KWP2000Base::getGearRatios(uint16_t ratios[])
+{
+    for (uint8_t g = 0; g < _gear_ratios; g++)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("P2 min too hight"));
-        }
-        return;
+        ratios[g] = _gear_ratio[g];
     }
+    return _gear_ratios;
+}
 
-    if (new_atp[1] > ISO_T_P2_MAX_LIMIT)
-    {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("P2 max too hight"));
-        }
-        return;
-    }
+/**
+ * @brief Get all the sensors values each time they are decoded, by `requestSensorsData()` or by the sniffer
+ * 
+ * @param callback The function to call, `nullptr` to stop
+ */
+void KWP2000Base::setSensorsCallback(sensors_callback_t callback)
+{
+    _sensors_callback = callback;
+}
 
-    if (new_atp[2] > 255)
+/**
+ * @brief Call it in the loop: it keeps the connection alive, then sends the queued requests (see `queueRequest()`) 
+ *          and the sensors requests by priority and deadline, then checks the DTC in the gaps (see `monitorTroubleCodes()`), 
+ *          or in place of the sensors when there hasn't been a gap for two intervals. 
+ *          Only one request is sent for each call, so a frame is never delayed by another one in the middle
+ */
+void KWP2000Base::update()
+{
+    if (_flags.ECU_status == false)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("P3 min too hight"));
-        }
         return;
     }
 
-    if (new_atp[3] > ISO_T_P3_MAX_LIMIT)
+    // the keep alive has the hard deadline of P3 max, but it sends nothing while the other requests keep the connection alive
+    const uint32_t last_sent = _last_request_sent;
+    keepAlive();
+    if (_flags.ECU_status == false || _last_request_sent != last_sent)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("P3 max too hight"));
-        }
         return;
     }
 
-    if (new_atp[4] > ISO_T_P4_MAX_LIMIT)
-    {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            _debug->println(F("P4 min too hight"));
-        }
-        return;
-    }
-    // all check passed
+    // the highest priority first, then the earliest deadline. A request without deadline is due when it is queued
+    const uint32_t now = KWP2000_MILLIS();
+    const uint16_t interval = _flags.capturing == true && _capture_interval != 0 ? _capture_interval : _sensors_interval;
+    int8_t next = -1; // the index in the queue, KWP2000_MAX_QUEUE for the sensors
+    uint8_t next_priority = PRIORITY_LOW;
+    uint32_t next_deadline = 0;
 
-    // convert the data if P2 and P3 max are too high for a tiny byte
-    uint32_t p2_max_temp = new_atp[1];
-    uint32_t p3_max_temp = new_atp[3];
+    // a DTC check which waited for a gap since two intervals takes the place of the sensors, within its bus share
+    const uint8_t dtc_overdue = _dtc_interval != 0 && now - _last_dtc_poll >= 2 * (uint32_t)_dtc_interval && troubleCodesDue(now) == true;
 
-    if (p2_max_temp <= 6000)
+    if (interval != 0 && now - _last_sensors_request >= interval && dtc_overdue == false)
     {
-        p2_max_temp = p2_max_temp / 25;
-    }
-    else if (p2_max_temp > 6000)
-    {
-        p2_max_temp = (p2_max_temp / 256 / 25) | 0xf0;
+        // before the next one is due
+        next = KWP2000_MAX_QUEUE;
+        next_priority = PRIORITY_NORMAL;
+        next_deadline = _last_sensors_request == 0 ? now + interval : _last_sensors_request + 2 * interval;
     }
-    new_atp[1] = p2_max_temp;
 
-    if (p3_max_temp <= 6000)
+    for (uint8_t q = 0; q < _queue_len; q++)
     {
-        p3_max_temp = p3_max_temp / 25;
+        // the waiting requests move to the next priority, so the sensors can't starve the low ones
+        const uint32_t deadline = _queue[q].queued + _queue[q].deadline;
+        const uint32_t promotions = (now - _queue[q].queued) / KWP2000_QUEUE_AGING;
+        const uint8_t priority = promotions >= _queue[q].priority ? (uint8_t)PRIORITY_HIGH : _queue[q].priority - promotions;
+        if (next < 0 || priority < next_priority ||
+            (priority == next_priority && (int32_t)(deadline - next_deadline) < 0))
+        {
+            next = q;
+            next_priority = priority;
+            next_deadline = deadline;
+        }
     }
-    else if (p3_max_temp > 6000)
+
+    if (next == KWP2000_MAX_QUEUE)
     {
-        p3_max_temp = (p3_max_temp / 256 / 25) | 0xf0;
+        requestSensorsData();
+        scheduled(next_deadline);
+        return;
     }
-    new_atp[3] = p3_max_temp;
 
-    // we need to create a new array made from the atp_set_given + new_atp + checksum
-    uint8_t pid_temp[7];
-    for (uint8_t n = 0; n < 7; n++)
+    if (next >= 0)
     {
-        if (n < 2) // atp_set_given
+        // out of the queue before the callback, which can queue another request
+        const uint8_t *request = _queue[next].request;
+        const uint8_t len = _queue[next].len;
+        const uint16_t deadline = _queue[next].deadline;
+        const request_callback_t callback = _queue[next].callback;
+        _queue_len--;
+        for (uint8_t q = next; q < _queue_len; q++)
         {
-            pid_temp[n] = atp_set_given[n];
+            _queue[q] = _queue[q + 1];
         }
-        else // new_atp
+
+        const int8_t result = handleRequest(request, len);
+        if (deadline != 0)
         {
-            pid_temp[n] = new_atp[n - 2];
+            scheduled(next_deadline);
         }
-    }
-
-    // send it
-    if (handleRequest(pid_temp, LEN(pid_temp)) == true)
-    {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        else
         {
-            _debug->println(F("Changed"));
+            _scheduler_stats.completed++;
         }
-    }
-    else
-    {
-        if (_debug_level >= DEBUG_LEVEL_DEFAULT)
+        if (callback != nullptr)
         {
-            _debug->println(F("Not changed"));
+            callback(request, result);
         }
+        return;
     }
 
-    // check if our values has been setted correctly
-    accessTimingParameter(true);
+    if (troubleCodesDue(now) == true)
+    {
+        _last_dtc_poll = now;
+        pollTroubleCodes();
+        _dtc_poll_time = KWP2000_MILLIS() - now;
+        _dtc_bus_time += _dtc_poll_time;
+    }
 }
 
-/////////////////// PRINT and GET ///////////////////////
+/**
+ * @brief Send a request with `update()`, when its turn comes: the highest priority first and in the same priority 
+ *          the earliest deadline first. The sensors requests have `PRIORITY_NORMAL` and the deadline of the next one
+ * 
+ * @param to_send The request, it must exist until the callback is called
+ * @param send_len The lenght of the request
+ * @param callback Optional. Called with the result of `handleRequest()`
+ * @param priority Optional, default to `PRIORITY_NORMAL`. One of the `request_priority`, every `KWP2000_QUEUE_AGING` ms 
+ *          in the queue the request moves to the next one
+ * @param deadline Optional, default to `0` (as soon as possible). Milliseconds from now, when it is completed 
+ *          later it is counted as missed in `getSchedulerStats()`
+ * @return `true` if queued, `-1` if there are already `KWP2000_MAX_QUEUE` requests waiting or the parameters are wrong
+ */
+int8_t KWP2000Base::queueRequest(const uint8_t to_send[], const uint8_t send_len, request_callback_t callback, const uint8_t priority, const uint16_t deadline)
+{
+    if (_queue_len == KWP2000_MAX_QUEUE || to_send == nullptr || send_len == 0 || priority > PRIORITY_LOW)
+    {
+        setError(EE_USER);
+        return -1;
+    }
+
+    _queue[_queue_len].request = to_send;
+    _queue[_queue_len].len = send_len;
+    _queue[_queue_len].priority = priority;
+    _queue[_queue_len].deadline = deadline;
+    _queue[_queue_len].queued = KWP2000_MILLIS();
+    _queue[_queue_len].callback = callback;
+    _queue_len++;
+    return true;
+}
+
+/**
+ * @brief How many requests of `update()` have been completed after their deadline, and how late
+ */
+const scheduler_stats &KWP2000Base::getSchedulerStats()
+{
+    return _scheduler_stats;
+}
+
+void KWP2000Base::resetSchedulerStats()
+{
+    _scheduler_stats = scheduler_stats();
+}
+
+////////////// CAPTURE ////////////////
+
+/**
+ * @brief Give the snapshots around the events to a logger: when a trigger fires (see `addTrigger()`) the callback gets 
+ *          the history before it, then every snapshot until the end of the window. Meanwhile `update()` asks for the 
+ *          sensors at the capture interval and leaves the DTC for later (see `setCaptureWindow()`)
+ * 
+ * @param callback The function to call, `nullptr` to stop
+ * @param history Optional. A ring for the snapshots before the trigger, its lenght and the sensors interval 
+ *          give how far back it can go
+ * @param history_len Optional. The number of snapshots of `history`
+ */
+void KWP2000Base::enableCapture(capture_callback_t callback, sensors_snapshot history[], const uint8_t history_len)
+{
+    _capture_callback = callback;
+    _history = history;
+    _history_len = history != nullptr ? history_len : 0;
+    _history_count = 0;
+    _history_next = 0;
+    _flags.capturing = false;
+}
+
+/**
+ * @brief Choose the lenght and the rate of the capture windows
+ * 
+ * @param pre_trigger Milliseconds of history given when a window opens
+ * @param post_trigger Milliseconds of the window after the last trigger, each trigger during the window extends it
+ * @param interval Optional, default to `1` (as fast as the ECU answers). The sensors interval during the window, 
+ *          `0` keeps the one of `setSensorsInterval()`
+ */
+void KWP2000Base::setCaptureWindow(const uint16_t pre_trigger, const uint16_t post_trigger, const uint16_t interval)
+{
+    _capture_pre = pre_trigger;
+    _capture_post = post_trigger;
+    _capture_interval = interval;
+}
+
+/**
+ * @brief Add a condition which opens a capture window, it is checked each time the sensors are decoded, 
+ *          except `TRIGGER_NEW_DTC` which is checked when the DTC are read again (see `monitorTroubleCodes()`)
+ * 
+ * @param type One of the `trigger_type`
+ * @param channel Optional, default to `CH_RPM`. One of the `sensor_channel`
+ * @param threshold Optional. In the same units of the channel
+ * @return The index of the trigger, given to the `capture_callback_t`, or `-1` if there are already 
+ *          `KWP2000_MAX_TRIGGERS` or the parameters are wrong
+ */
+int8_t KWP2000Base::addTrigger(const uint8_t type, const uint8_t channel, const uint16_t threshold)
+{
+    if (_triggers_count == KWP2000_MAX_TRIGGERS || type > TRIGGER_NEW_DTC || channel >= CH_TOTAL)
+    {
+        setError(EE_USER);
+        return -1;
+    }
+
+    _triggers[_triggers_count].type = type;
+    _triggers[_triggers_count].channel = channel;
+    _triggers[_triggers_count].threshold = threshold;
+    return _triggers_count++;
+}
+
+/**
+ * @brief Remove all the triggers, a window already open is closed as usual
+ */
+void KWP2000Base::clearTriggers()
+{
+    _triggers_count = 0;
+}
+
+/**
+ * @brief Check if a capture window is open
+ * 
+ * @return `true` if a trigger fired and the window is not over, `false` otherwise
+ */
+uint8_t KWP2000Base::isCapturing()
+{
+    return _flags.capturing;
+}
+
+/**
+ * @brief Check the triggers on the snapshot just decoded and give it to the capture callback, 
+ *          or keep it in the history if there isn't a window open
+ * 
+ * @param previous The snapshot decoded before, for `TRIGGER_DELTA`
+ */
+void KWP2000Base::captureSensors(const sensors_snapshot &previous)
+{
+    const sensors_snapshot snapshot = getSensors();
+
+    for (uint8_t t = 0; t < _triggers_count; t++)
+    {
+        const uint16_t value = snapshot.value[_triggers[t].channel];
+        const uint16_t before = previous.value[_triggers[t].channel];
+        uint8_t fired;
+        switch (_triggers[t].type)
+        {
+        case TRIGGER_ABOVE:
+            fired = value > _triggers[t].threshold;
+            break;
+        case TRIGGER_BELOW:
+            fired = value < _triggers[t].threshold;
+            break;
+        case TRIGGER_DELTA:
+            fired = previous.time != 0 && (value > before ? value - before : before - value) > _triggers[t].threshold;
+            break;
+        default:
+            fired = false; // not a sensors trigger
+            break;
+        }
+        if (fired == true)
+        {
+            fireTrigger(t, snapshot);
+            return;
+        }
+    }
+
+    if (_flags.capturing == true)
+    {
+        if ((int32_t)(snapshot.time - _capture_end) <= 0)
+        {
+            _capture_callback(snapshot, CAPTURE_LIVE, _capture_trigger);
+            return;
+        }
+        _flags.capturing = false;
+        _capture_callback(snapshot, CAPTURE_END, _capture_trigger);
+    }
+
+    if (_history_len != 0)
+    {
+        _history[_history_next] = snapshot;
+        _history_next = (_history_next + 1) % _history_len;
+        if (_history_count < _history_len)
+        {
+            _history_count++;
+        }
+    }
+}
+
+/**
+ * @brief Open a capture window, giving the history to the callback, or extend the window already open
+ * 
+ * @param trigger The index of the trigger
+ * @param snapshot The last snapshot decoded
+ */
+void KWP2000Base::fireTrigger(const uint8_t trigger, const sensors_snapshot &snapshot)
+{
+    if (_capture_callback == nullptr)
+    {
+        return;
+    }
+
+    _capture_end = KWP2000_MILLIS() + _capture_post;
+    if (_flags.capturing == true)
+    {
+        _capture_callback(snapshot, CAPTURE_LIVE, _capture_trigger);
+        return;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+    {
+        _debug->print(F("Capture opened by the trigger "));
+        _debug->println(trigger);
+    }
+
+    _flags.capturing = true;
+    _capture_trigger = trigger;
+    for (uint8_t n = 0; n < _history_count; n++)
+    {
+        const sensors_snapshot &old = _history[(_history_next + _history_len - _history_count + n) % _history_len];
+        // the snapshot of a DTC trigger is already in the history
+        if (snapshot.time - old.time <= _capture_pre && old.time != snapshot.time)
+        {
+            _capture_callback(old, CAPTURE_HISTORY, trigger);
+        }
+    }
+    _history_count = 0;
+    _capture_callback(snapshot, CAPTURE_TRIGGER, trigger);
+}
+
+////////////// SNIFFER ////////////////
+
+/**
+ * @brief Listen to the K-Line without transmitting, e.g. to see what a dealer tool asks to the ECU. 
+ *          Nothing is sent and `_k_out_pin` is never driven until `stopSniffer()`, call `sniff()` in the loop
+ * 
+ * @param callback Optional. Called for each valid frame, see `frame_callback_t`
+ */
+void KWP2000Base::startSniffer(frame_callback_t callback)
+{
+    if (_flags.ECU_status == true || _flags.init_sequence_started == true)
+    {
+        // we can't listen to somebody else while we are talking
+        setError(EE_USER);
+        return;
+    }
+
+    _frame_callback = callback;
+    _sniff_len = 0;
+    _sniff_expected = 0;
+    _flags.sniffing = true;
+    _kline->begin(_kline_baudrate, _kline_config);
+
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->println(F("Sniffer started"));
+    }
+}
+
+/**
+ * @brief Stop listening to the K-Line, after it `initKline()` can be used again
+ */
+void KWP2000Base::stopSniffer()
+{
+    if (_flags.sniffing == false)
+    {
+        return;
+    }
+    _flags.sniffing = false;
+    _kline->end();
+
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->println(F("Sniffer stopped"));
+    }
+}
+
+/**
+ * @brief Read the bytes on the bus and split them in frames: the header gives the lenght of the frame 
+ *          and a gap longer than P1/P4 max starts a new one. Call it often, it never waits
+ * 
+ * @return `true` if a frame has been completed (it is in `_response`), `false` otherwise
+ */
+int8_t KWP2000Base::sniff()
+{
+    if (_flags.sniffing == false)
+    {
+        setError(EE_USER);
+        return false;
+    }
+
+    while (_kline->available() > 0)
+    {
+        const uint8_t incoming = _kline->read();
+        const uint32_t now = KWP2000_MILLIS();
+        _last_byte_received = now;
+        TRACE(TRACE_RX, incoming);
+
+        if (_sniff_len > 0 && now - _sniff_last_byte > ISO_T_P4_MAX_LIMIT)
+        {
+            // the inter byte time is over, what we have is not a complete frame
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->print(F("Incomplete frame, bytes: "));
+                _debug->println(_sniff_len);
+            }
+            _sniff_len = 0;
+            _sniff_expected = 0;
+        }
+        _sniff_last_byte = now;
+
+        if (_sniff_len >= _response_size)
+        {
+            setError(EE_BUFFER);
+            _sniff_len = 0;
+            _sniff_expected = 0;
+            continue;
+        }
+        _response[_sniff_len++] = incoming;
+
+        if (_sniff_expected == 0)
+        {
+            // wait for the header to know the lenght of the frame
+            const uint8_t header_len = ((_response[0] & 0xC0) != 0 ? 3 : 1) + ((_response[0] & 0x3F) == 0 ? 1 : 0);
+            if (_sniff_len == header_len)
+            {
+                const uint8_t data_len = (_response[0] & 0x3F) != 0 ? _response[0] & 0x3F : _response[header_len - 1];
+                _sniff_expected = header_len + data_len + 1;
+            }
+        }
+
+        if (_sniff_expected != 0 && _sniff_len == _sniff_expected)
+        {
+            const uint16_t frame_len = _sniff_len;
+            _sniff_len = 0;
+            _sniff_expected = 0;
+
+            if (_response[frame_len - 1] != calc_checksum(_response, frame_len - 1))
+            {
+                TRACE(TRACE_CHECKSUM, false);
+                setError(EE_CS);
+                continue;
+            }
+            TRACE(TRACE_CHECKSUM, true);
+
+            _response_len = frame_len - 1;
+            _response_data_start = ((_response[0] & 0xC0) != 0 ? 3 : 1) + ((_response[0] & 0x3F) == 0 ? 1 : 0);
+            _frames[0].data_start = _response_data_start;
+            _frames[0].len = _response_len;
+            _frames_count = 1;
+            snifferFrame();
+            return true;
+        }
+    }
+    return false;
+}
+
+////////////// COMMUNICATION - Advanced ////////////////
+/**
+ * @brief Choose how long the K-Line must be silent before we send a request, measured from the last byte received
+ * 
+ * @param idle Time in milliseconds, default to 20 (the max inter byte time of a frame). `0` sends without waiting
+ */
+void KWP2000Base::setBusIdle(const uint16_t idle)
+{
+    _bus_idle = idle;
+}
+
+/**
+ * @brief Choose how long to wait for other responses to the same request. Some requests (e.g. a long list of DTC) 
+ *          are answered with more than one response, each response is kept up to `KWP2000_MAX_FRAMES`, see `getResponseCount()`
+ * 
+ * @param enable Optional, default to `true`. With `true` after each response we wait P2 max, 
+ *          with `false` only P3 min (the time to wait anyway before the next request)
+ */
+void KWP2000Base::collectResponses(const uint8_t enable)
+{
+    _flags.all_responses = enable == true;
+}
+
+/**
+ * @brief This function is the core of the library. You just need to give a PID and it will generate the header, calculate the checksum and try to send the request. 
+ *          Then it will check if the response is correct and if not it will try to send the request again, as chosen by the retry policy 
+ *          of its service (see `setRetryPolicy()`), all is based on the ISO14230
+ * 
+ * @param to_send The PID you want to send, see PID.h for more detail
+ * @param send_len The lenght of the PID (use `sizeof` to get it)
+ * @param try_once Optional, default to `false`. Choose if you want to try to send the request only once in case of error
+ * @return `true` if the request has been sent and a correct response has been received, `-2` if it is too long for the request buffer, 
+ *          `-3` if its service has been stopped by the circuit breaker, a `negative number` otherwise
+ */
+int8_t KWP2000Base::handleRequest(const uint8_t to_send[], const uint8_t send_len, const uint8_t try_once)
+{
+    uint8_t completed = false;
+
+    if (requestHeaderLength(send_len) + send_len + 1 > _request_size)
+    {
+        // it doesn't fit in the request buffer, see KWP2000Sized
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("Request too long for the buffer"));
+        }
+        setError(EE_BUFFER);
+        return -2;
+    }
+
+    retry_policy_t policy = default_retry_policy;
+    int8_t p = _policies_count - 1;
+    while (p >= 0 && _policies[p].sid != to_send[0])
+    {
+        p--;
+    }
+    if (p >= 0)
+    {
+        policy = _policies[p].policy;
+        if (policy.breaker != 0 && _policies[p].failed >= policy.breaker)
+        {
+            if (KWP2000_MILLIS() - _policies[p].since < policy.probe)
+            {
+                // the breaker is open
+                setError(EE_BREAKER);
+                return -3;
+            }
+            // half open: a single probe
+            policy.attempts = 1;
+        }
+    }
+
+    const uint8_t attempts = try_once == true ? 1 : policy.attempts;
+    uint8_t attempt = 1;
+    while (attempt <= attempts && completed == false)
+    {
+        // the collisions are handled by sendRequest(), they don't count as attempts
+        _last_nrc = 0;
+        if (sendRequest(to_send, send_len) == true)
+        {
+            listenResponse();
+            completed = checkResponse(to_send) == true;
+        }
+
+        if (completed == false)
+        {
+            // no answer is worth another attempt, a negative response only if the ECU may change its mind
+            const uint8_t retry = _last_nrc == 0 || _last_nrc == 0x21 || _last_nrc == policy.retry_nrc[0] || _last_nrc == policy.retry_nrc[1];
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->print(F("Attempt "));
+                _debug->print(attempt);
+                _debug->print(F(" not luckly"));
+                _debug->println(attempt < attempts && retry == true ? ", trying again"
+                                                                     : "\nWe wasn't able to comunicate");
+            }
+            if (retry == false)
+            {
+                break;
+            }
+
+            if (attempt < attempts && policy.backoff != 0)
+            {
+                uint32_t wait = (uint32_t)policy.backoff << (attempt - 1);
+                wait += random(wait / 2 + 1);
+                // a longer wait would close the connection
+                KWP2000_DELAY(wait < ISO_T_P3_MAX / 2 ? wait : ISO_T_P3_MAX / 2);
+            }
+            attempt++;
+        }
+    }
+
+    if (p >= 0)
+    {
+        if (completed == true)
+        {
+            _policies[p].failed = 0;
+        }
+        else if (_policies[p].failed < 0xFF)
+        {
+            _policies[p].failed++;
+            if (policy.breaker != 0 && _policies[p].failed == policy.breaker && DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+            {
+                _debug->print(F("Service stopped: "));
+                _debug->println(to_send[0], HEX);
+            }
+        }
+        _policies[p].since = KWP2000_MILLIS();
+    }
+
+    if (completed == true)
+    {
+        return true;
+    }
+    else
+    {
+        // we made all the attemps so there is a problem
+        return -1;
+    }
+}
+
+/**
+ * @brief Choose how `handleRequest()` tries again the requests of a service and when it stops sending them: 
+ *          after `breaker` failed requests in a row it returns `-3` without sending, until a probe every `probe` ms succeeds
+ * 
+ * @param sid The service, e.g. `0x18` for the DTC
+ * @param policy See `retry_policy_t`
+ * @return `true` if it is used from now on, `-1` if there are already `KWP2000_MAX_POLICIES` or it has no attempts
+ */
+int8_t KWP2000Base::setRetryPolicy(const uint8_t sid, const retry_policy_t &policy)
+{
+    if (policy.attempts == 0)
+    {
+        setError(EE_USER);
+        return -1;
+    }
+
+    uint8_t p = 0;
+    while (p < _policies_count && _policies[p].sid != sid)
+    {
+        p++;
+    }
+    if (p == KWP2000_MAX_POLICIES)
+    {
+        setError(EE_USER);
+        return -1;
+    }
+    if (p == _policies_count)
+    {
+        _policies_count++;
+    }
+
+    _policies[p].sid = sid;
+    _policies[p].policy = policy;
+    _policies[p].failed = 0;
+    _policies[p].since = 0;
+    return true;
+}
+
+/**
+ * @brief All the services go back to the 3 immediate attempts, the stopped ones are sent again
+ */
+void KWP2000Base::clearRetryPolicies()
+{
+    _policies_count = 0;
+}
+
+/**
+ * @brief Ask and print the Timing Parameters from the ECU
+ * 
+ * @param read_only Optional, default to `true`. This avoid the possibility to unintentionally change them
+ */
+void KWP2000Base::accessTimingParameter(const uint8_t read_only)
+{
+    timingParameter(&_response[_response_data_start + 2], read_only);
+}
+
+/**
+ * @brief Decode the Timing Parameters as they are sent by the ECU
+ * 
+ * @param atp P2 min, P2 max, P3 min, P3 max and P4 min
+ * @param read_only Choose if they will be used from now on
+ */
+void KWP2000Base::timingParameter(const uint8_t atp[], const uint8_t read_only)
+{
+    uint8_t p2_min_temp = atp[0];
+    uint16_t p3_min_temp = atp[2];
+    uint16_t p4_min_temp = atp[4];
+
+    uint32_t p2_max_temp = atp[1];
+    if (p2_max_temp <= 0xF0)
+    {
+        p2_max_temp *= 25;
+    }
+    else if ((p2_max_temp > 0xF0) && (p2_max_temp < 0xFF))
+    {
+        p2_max_temp = (p2_max_temp & 0xF) * 256 * 25;
+    }
+    else if (p2_max_temp == 0xFF)
+    {
+        p2_max_temp = 89601;
+        setError(EE_ATP);
+    }
+
+    uint32_t p3_max_temp = atp[3];
+    if (p3_max_temp <= 0xF0)
+    {
+        p3_max_temp *= 25;
+    }
+    else if ((p3_max_temp > 0xF0) && (p3_max_temp < 0xFF))
+    {
+        p3_max_temp = (p3_max_temp & 0xF) * 256 * 25;
+    }
+    else if (p3_max_temp == 0xFF)
+    {
+        p3_max_temp = 89601;
+        setError(EE_ATP);
+    }
+
+    // any of these condition is an error
+    if ((p2_min_temp > p2_max_temp) || (p3_min_temp > p3_max_temp) || (p4_min_temp > ISO_T_P4_MAX_LIMIT) || (p3_min_temp < p4_min_temp))
+    {
+        setError(EE_ATP);
+    }
+
+    if (read_only == false)
+    {
+        ISO_T_P2_MIN = p2_min_temp;
+        ISO_T_P2_MAX = p2_max_temp;
+        ISO_T_P3_MIN = p3_min_temp;
+        ISO_T_P3_MAX = p3_max_temp;
+        ISO_T_P4_MIN = p4_min_temp;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+    {
+        _debug->println(F("Timing Parameter from the ECU:"));
+        _debug->print("Errors:\t");
+        _debug->println(bitRead(_ECU_error, EE_ATP) == 1 ? "Yes" : "No");
+        _debug->print(F("P2 min:\t"));
+        _debug->println(p2_min_temp);
+        _debug->print(F("P2 max:\t"));
+        _debug->println(p2_max_temp);
+        _debug->print(F("P3 min:\t"));
+        _debug->println(p3_min_temp);
+        _debug->print(F("P3 max:\t"));
+        _debug->println(p3_max_temp);
+        _debug->print(F("P4 min:\t"));
+        _debug->println(p4_min_temp);
+        _debug->println();
+    }
+}
+
+/**
+ * @brief Reset the Timing Parameters to the default settings from the ECU
+ */
+void KWP2000Base::resetTimingParameter()
+{
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->println(F("Resetting time parameters to default"));
+    }
+    if (handleRequest(atp_set_default, LEN(atp_set_default)) == true)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+        {
+            _debug->println(F("Changed"));
+        }
+    }
+    else
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+        {
+            _debug->println(F("Not changed"));
+        }
+    }
+    accessTimingParameter(true);
+}
+
+/**
+ * @brief Change the Timing Parameters to custom ones
+ * 
+ * @param new_atp Array of 5 elements containing the new parameters
+ * @param new_atp_len The lenght of the array (use `sizeof` to get it)
+ */
+void KWP2000Base::changeTimingParameter(uint32_t new_atp[], const uint8_t new_atp_len)
+{
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->println(F("Changing timing parameter"));
+    }
+
+    if (new_atp_len != 5)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("The time paramenter should be an array of 5 elements"));
+        }
+        setError(EE_USER);
+        return;
+    }
+
+    if (new_atp[0] > ISO_T_P2_MIN_LIMIT)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("P2 min too hight"));
+        }
+        return;
+    }
+
+    if (new_atp[1] > ISO_T_P2_MAX_LIMIT)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("P2 max too hight"));
+        }
+        return;
+    }
+
+    if (new_atp[2] > 255)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("P3 min too hight"));
+        }
+        return;
+    }
+
+    if (new_atp[3] > ISO_T_P3_MAX_LIMIT)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("P3 max too hight"));
+        }
+        return;
+    }
+
+    if (new_atp[4] > ISO_T_P4_MAX_LIMIT)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->println(F("P4 min too hight"));
+        }
+        return;
+    }
+    // all check passed
+
+    // convert the data if P2 and P3 max are too high for a tiny byte
+    uint32_t p2_max_temp = new_atp[1];
+    uint32_t p3_max_temp = new_atp[3];
+
+    if (p2_max_temp <= 6000)
+    {
+        p2_max_temp = p2_max_temp / 25;
+    }
+    else if (p2_max_temp > 6000)
+    {
+        p2_max_temp = (p2_max_temp / 256 / 25) | 0xf0;
+    }
+    new_atp[1] = p2_max_temp;
+
+    if (p3_max_temp <= 6000)
+    {
+        p3_max_temp = p3_max_temp / 25;
+    }
+    else if (p3_max_temp > 6000)
+    {
+        p3_max_temp = (p3_max_temp / 256 / 25) | 0xf0;
+    }
+    new_atp[3] = p3_max_temp;
+
+    // we need to create a new array made from the atp_set_given + new_atp + checksum
+    uint8_t pid_temp[7];
+    for (uint8_t n = 0; n < 7; n++)
+    {
+        if (n < 2) // atp_set_given
+        {
+            pid_temp[n] = atp_set_given[n];
+        }
+        else // new_atp
+        {
+            pid_temp[n] = new_atp[n - 2];
+        }
+    }
+
+    // send it
+    if (handleRequest(pid_temp, LEN(pid_temp)) == true)
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+        {
+            _debug->println(F("Changed"));
+        }
+    }
+    else
+    {
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+        {
+            _debug->println(F("Not changed"));
+        }
+    }
+
+    // check if our values has been setted correctly
+    accessTimingParameter(true);
+}
+
+/**
+ * @brief Find which identifiers of a service are supported by the ECU, e.g. the local identifiers of 0x21. 
+ *          Each identifier is asked only once and the ECU has P2 max to answer, then the negative response tells why it was rejected
+ * 
+ * @param sid The service to scan
+ * @param first The first identifier
+ * @param last The last identifier
+ * @param callback Optional. Called for each identifier with the result and the data of the response, see `scan_callback_t`
+ * @return The number of supported identifiers, a `negative number` if the ECU is not connected or doesn't support the service
+ */
+int16_t KWP2000Base::scanIdentifiers(const uint8_t sid, const uint8_t first, const uint8_t last, scan_callback_t callback)
+{
+    if (_flags.ECU_status == false || first > last)
+    {
+        setError(EE_USER);
+        return -1;
+    }
+
+    int16_t supported = 0;
+    uint8_t to_send[2] = {sid, first};
+
+    for (uint16_t id = first; id <= last; id++)
+    {
+        to_send[1] = id;
+        _last_nrc = 0; // a request that is not sent must not find the answer of an older one
+        const int8_t sent = sendRequest(to_send, LEN(to_send));
+        if (sent == true)
+        {
+            // the ECU must start to answer within P2 max, the 2 seconds of P3 are only for the end of the session
+            listenResponse(true, ISO_T_P2_MAX + ISO_T_P4_MAX_LIMIT);
+        }
+
+        uint8_t result;
+        if (sent != true)
+        {
+            result = SCAN_NO_ANSWER;
+        }
+        else if (checkResponse(to_send) == true && _response_len > _response_data_start + 1 && _response[_response_data_start + 1] == id)
+        {
+            result = SCAN_SUPPORTED;
+            supported++;
+        }
+        else if (_response_len == 0 || _last_nrc == 0)
+        {
+            // a positive answer for another identifier is a late one, this identifier had no answer
+            result = SCAN_NO_ANSWER;
+        }
+        else if (_last_nrc == 0x11 || _last_nrc == 0x12 || _last_nrc == 0x31)
+        {
+            result = SCAN_NOT_SUPPORTED;
+        }
+        else
+        {
+            // e.g. security access denied or conditions not correct: the identifier exists
+            result = SCAN_REJECTED;
+        }
+
+        if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+        {
+            _debug->print(id, HEX);
+            _debug->print(F(":\t"));
+            _debug->println(result == SCAN_SUPPORTED ? F("supported") : result == SCAN_REJECTED ? F("rejected") : result == SCAN_NO_ANSWER ? F("no answer") : F("not supported"));
+        }
+
+        if (callback != nullptr)
+        {
+            const uint16_t data_start = result == SCAN_SUPPORTED ? _response_data_start + 2 : _response_len;
+            callback(sid, id, result, &_response[data_start], _response_len - data_start);
+        }
+
+        if (sent == true && _last_nrc == 0x11)
+        {
+            // serviceNotSupported: the other identifiers would get the same answer
+            return -2;
+        }
+    }
+
+    return supported;
+}
+
+/////////////////// PRINT and GET ///////////////////////
+
+/**
+ * @brief Print a rich and useful set of information about the ECU status and errors
+ * 
+ * @param time Optional, default to `2000`milliseconds. The time between one print and the other
+ */
+void KWP2000Base::printStatus(uint16_t time)
+{
+    if (time == false)
+    {
+        // skip
+        return;
+    }
+
+    if (KWP2000_MILLIS() - _last_status_print <= time)
+    {
+        // not enough time has passed since last time we printed the status
+        return;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->print(F("\n---- STATUS ----\n"));
+        _debug->print(F("Connection:\t\t"));
+        _debug->println(_flags.ECU_status == 1 ? "Connected" : "Not connected");
+        _debug->print(F("Errors:\t\t\t"));
+        _debug->println(_ECU_error == 0 ? "No" : "Yes");
+
+        if (_last_correct_response != 0)
+        {
+            _debug->print(F("Last data:\t\t"));
+            printSecondsAgo(_last_correct_response);
+        }
+
+        if (_connection_time != 0)
+        {
+            _debug->print(F("Connection time:"));
+            printSecondsAgo(_connection_time);
+        }
+
+        _debug->print(F("Baudrate:\t\t"));
+        _debug->println(_kline_baudrate);
+        if (_scheduler_stats.completed != 0)
+        {
+            _debug->print(F("Missed deadlines:\t"));
+            _debug->print(_scheduler_stats.missed);
+            _debug->print(F(" of "));
+            _debug->println(_scheduler_stats.completed);
+        }
+        _debug->print(F("K-line TX pin:\t"));
+        _debug->println(_k_out_pin);
+#if defined(SUZUKI)
+        _debug->print(F("Dealer pin:\t\t"));
+        _debug->println(_dealer_pin);
+        _debug->print(F("Dealer mode:\t"));
+        _debug->println(_flags.dealer_mode == 1 ? "Enabled" : "Disabled");
+#endif
+        //other stuff?
+        if (_ECU_error != 0)
+        {
+            _debug->print(F("\n---- ERRORS ----\n"));
+            for (uint8_t i = 0; i < EE_TOTAL; i++)
+            {
+                if (bitRead(_ECU_error, i) != 0)
+                {
+                    switch (i)
+                    {
+                    case EE_USER:
+                        _debug->println(F("We called some function in a wrong way"));
+                        break;
+                    case EE_START:
+                        _debug->println(F("Unable to start comunication"));
+                        break;
+                    case EE_STOP:
+                        _debug->println(F("Unable to stop comunication"));
+                        break;
+                    case EE_TO:
+                        _debug->println(F("Data is not for us"));
+                        break;
+                    case EE_FROM:
+                        _debug->println(F("Data don't came from the ECU"));
+                        break;
+                    case EE_CS:
+                        _debug->println(F("Checksum error"));
+                        break;
+                    case EE_ECHO:
+                        _debug->println(F("Echo error"));
+                        break;
+                    case EE_UNEX:
+                        _debug->println(F("Unexpected error"));
+                        break;
+                    case EE_HEADER:
+                        _debug->println(F("Unexpected header"));
+                        break;
+                    case EE_CONFIG:
+                        _debug->println(F("The key bytes are probably wrong"));
+                        break;
+                    case EE_P3MAX:
+                        _debug->println(F("Time out of the communication"));
+                        break;
+                    case EE_CR:
+                        _debug->println(F("Check response error"));
+                        break;
+                    case EE_ATP:
+                        _debug->println(F("Problem setting the timing parameter"));
+                        break;
+                    case EE_WR:
+                        _debug->println(F("We get a reject for a request we didn't sent"));
+                        break;
+                    case EE_US:
+                        _debug->println(F("Unsupported, yet"));
+                        break;
+                    case EE_BUFFER:
+                        _debug->println(F("Data too long for the buffers"));
+                        break;
+                    case EE_BUS:
+                        _debug->println(F("Bus busy or collision"));
+                        break;
+                    case EE_BREAKER:
+                        _debug->println(F("Service stopped after too many failures"));
+                        break;
+                    default:
+                        _debug->print(F("Did I forget any enum?"));
+                        _debug->println(i);
+                        break;
+                    }
+                }
+            }
+        }
+        _debug->print(F("---- ------- ----\n\n"));
+        _last_status_print = KWP2000_MILLIS();
+    }
+    else
+    {
+        setError(EE_USER);
+    }
+}
+
+/**
+ * @brief Print all the sensors data from the ECU, you need to run `requestSensorsData()` before
+ */
+void KWP2000Base::printSensorsData()
+{
+    if (_last_sensors_calculated == 0)
+    {
+        // we didn't run requestSensorsData
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+        {
+            _debug->print(F("requestSensorsData need to be called before"));
+        }
+        setError(EE_USER);
+        return;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->print(F("---- SENSORS ----\n"));
+        _debug->print(F("Calculated: "));
+        printSecondsAgo(_last_sensors_calculated);
+        _debug->print(F("GPS:\t"));
+        _debug->println(_GPS);
+        _debug->print(F("RPM:\t"));
+        _debug->println(_RPM);
+        _debug->print(F("Speed:\t"));
+        _debug->println(_SPEED);
+        _debug->print(F("TPS:\t"));
+        _debug->println(_TPS);
+        _debug->print(F("IAP:\t"));
+        _debug->println(_IAP);
+        _debug->print(F("IAT:\t"));
+        _debug->println(_IAT);
+        _debug->print(F("ECT:\t"));
+        _debug->println(_ECT);
+        _debug->print(F("STPS:\t"));
+        _debug->println(_STPS);
+        //_debug->print(F(":\t"));_debug->println();
+
+        _debug->print(F("_GEAR1:\t"));
+        _debug->println(_GEAR1, BIN);
+        _debug->print(F("_GEAR2:\t"));
+        _debug->println(_GEAR2, BIN);
+        _debug->print(F("_GEAR3:\t"));
+        _debug->println(_GEAR3, BIN);
+
+        _debug->print(F("---- ------- ----\n"));
+        _last_data_print = KWP2000_MILLIS();
+    }
+    else
+    {
+        setError(EE_USER);
+    }
+}
+
+/**
+ * @brief Print the last response received from the ECU
+ */
+void KWP2000Base::printLastResponse()
+{
+    if (DEBUG_AT(DEBUG_LEVEL_DEFAULT))
+    {
+        _debug->println(F("Last Response from the ECU:"));
+        for (uint16_t n = 0; n < _response_len; n++)
+        {
+            _debug->println(_response[n], HEX);
+        }
+    }
+    else
+    {
+        setError(EE_USER);
+    }
+}
+
+/**
+ * @brief Get the data of the last response, from the SID to the checksum (excluded)
+ * 
+ * @param frame Optional, default to `0`. Which response, if the ECU sent more than one, see `getResponseCount()`
+ * @return The data, its lenght is given by `getResponseLength()`. `nullptr` if there isn't that response
+ */
+const uint8_t *KWP2000Base::getResponseData(const uint8_t frame)
+{
+    if (frame == 0)
+    {
+        return &_response[_response_data_start];
+    }
+    if (frame >= _frames_count)
+    {
+        return nullptr;
+    }
+    return &_response[_frames[frame].data_start];
+}
+
+/**
+ * @brief Get the lenght of the data of the last response, see `getResponseData()`
+ * 
+ * @param frame Optional, default to `0`. Which response, if the ECU sent more than one, see `getResponseCount()`
+ * @return The lenght, `0` if there isn't a response
+ */
+uint16_t KWP2000Base::getResponseLength(const uint8_t frame)
+{
+    if (frame == 0)
+    {
+        return _response_len > _response_data_start ? _response_len - _response_data_start : 0;
+    }
+    if (frame >= _frames_count)
+    {
+        return 0;
+    }
+    return _frames[frame].len - _frames[frame].data_start;
+}
+
+/**
+ * @brief Get how many responses the ECU sent to the last request, see `collectResponses()`
+ * 
+ * @return The number of responses, `0` if there isn't a response
+ */
+uint8_t KWP2000Base::getResponseCount()
+{
+    return _frames_count;
+}
+
+/**
+ * @brief Get the line config of the K-Line: the one given to the constructor or the one found by `enableAutoBaud()`
+ * 
+ * @return The baudrate and the config given to `begin()`
+ */
+line_config_t KWP2000Base::getLineConfig()
+{
+    return {_kline_baudrate, _kline_config};
+}
+
+/**
+ * @brief Get the connection status
+ * 
+ * @return It could be `true` or `false`
+ */
+int8_t KWP2000Base::getStatus()
+{
+    return _flags.ECU_status;
+}
+
+/**
+ * @brief This say you only if there are/aren't errors, to see them use `printStatus()`
+ * 
+ * @return It could be `true` or `false`
+ */
+int8_t KWP2000Base::getError()
+{
+    if (_ECU_error == 0)
+    {
+        return 1;
+    }
+    else
+    {
+        return -1;
+    }
+}
+
+/**
+ * @brief Reset the errors from the ECU, use with caution
+ */
+void KWP2000Base::resetError()
+{
+    _ECU_error = 0;
+}
+
+/**
+ * @brief Get the code of the last negative response of the ECU
+ * 
+ * @return The negative response code, `0` if the last response was not negative
+ */
+uint8_t KWP2000Base::getLastNRC()
+{
+    return _last_nrc;
+}
+
+/**
+ * @brief Get how many DTC the ECU reported in the last `readTroubleCodes()` or `pollTroubleCodes()`, 
+ *          only the first `KWP2000_MAX_DTC` are kept
+ * 
+ * @return The number of DTC
+ */
+uint8_t KWP2000Base::getTroubleCodesCount()
+{
+    return _dtc_total;
+}
+
+/**
+ * @brief Get one of the DTC kept by the last `readTroubleCodes()`
+ * 
+ * @param index From `0` to `getTroubleCodesCount() - 1`, and less than `KWP2000_MAX_DTC`
+ * @return The DTC, its `code` is `0` if the index is not valid
+ */
+dtc_t KWP2000Base::getTroubleCode(const uint8_t index)
+{
+    if (index >= _dtc_stored)
+    {
+        const dtc_t empty = {0, 0};
+        return empty;
+    }
+    return _dtc[index];
+}
+
+/**
+ * @brief Get the identification read by `readECUIdentification()`
+ * 
+ * @return The identification, its `fingerprint` is `0` if it has not been read
+ */
+const ecu_id_t &KWP2000Base::getECUIdentification()
+{
+    return _ecu_id;
+}
+
+/**
+ * @brief Get all the sensors values from the last response
+ * 
+ * @return The values and when they have been decoded, `time` is `0` if they have never been decoded
+ */
+sensors_snapshot KWP2000Base::getSensors()
+{
+    sensors_snapshot snapshot;
+    snapshot.time = _last_sensors_calculated;
+    snapshot.value[CH_GPS] = _GPS;
+    snapshot.value[CH_RPM] = _RPM;
+    snapshot.value[CH_SPEED] = _SPEED;
+    snapshot.value[CH_TPS] = _TPS;
+    snapshot.value[CH_IAP] = _IAP;
+    snapshot.value[CH_IAT] = _IAT;
+    snapshot.value[CH_ECT] = _ECT;
+    snapshot.value[CH_STPS] = _STPS;
+    return snapshot;
+}
+
+/**
+ * @brief Get* the ECU sensor value you need
+ * GPS: Gear Position Sensor
+ * RPM: Right Per Minutes
+ * SPEED: speed of the bike
+ * TPS: Throttle Position Sensor
+ * IAP: Intake Air Pressure
+ * IAT: Intake Air Temperature
+ * ECT: Engine Coolant Temperature
+ * STPS: Secondary Throttle Position Sensor
+ * @return The sensor value from the ECU
+ */
+uint8_t KWP2000Base::getGPS()
+{
+    return _GPS;
+}
+
+uint16_t KWP2000Base::getRPM()
+{
+    return _RPM;
+}
+
+uint8_t KWP2000Base::getSPEED()
+{
+    return _SPEED;
+}
+
+uint8_t KWP2000Base::getTPS()
+{
+    return _TPS;
+}
+
+uint8_t KWP2000Base::getIAP()
+{
+    return _IAP;
+}
+
+uint8_t KWP2000Base::getIAT()
+{
+    return _IAT;
+}
+
+uint8_t KWP2000Base::getECT()
+{
+    return _ECT;
+}
+
+uint8_t KWP2000Base::getSTPS()
+{
+    return _STPS;
+}
+
+/////////////////// PRIVATE ///////////////////////
+
+/**
+ * @brief Generate and send a request to the ECU
+ * 
+ * @param pid The PID you want to send
+ * @param pid_len the lenght of the PID, get it with `sizeof()` 
+ * @param wait_to_send_all Choose to wait untill the tx buffer is empty
+ * @param use_delay Choose to wait at the end of the function or to do other tasks
+ * @return `true` if the request has been sent, `-1` while sniffing, `-2` if the bus was never idle, 
+ *          `-3` if it collided more than `KWP2000_MAX_COLLISIONS` times
+ */
+int8_t KWP2000Base::sendRequest(const uint8_t pid[], const uint8_t pid_len, const uint8_t wait_to_send_all, const uint8_t use_delay)
+{
+    const uint8_t header_len = requestHeaderLength(pid_len);
+
+    if (_flags.sniffing == true)
+    {
+        // the sniffer never transmits
+        setError(EE_USER);
+        return -1;
+    }
+
+    // create the request
+    // make the header
+    if (header_len == 2 || header_len == 4)
+    {
+        // we use the lenth byte, with 64 bytes or more we are forced to use it
+        _request[0] = format_physical;
+        _request[header_len - 1] = pid_len;
+    }
+    else
+    {
+        // the lenght byte is "inside" the format
+        _request[0] = format_physical | pid_len;
+    }
+
+    if (_link.layout == LAYOUT_FMT_ADDR || _link.layout == LAYOUT_FMT_ADDR_LEN)
+    {
+        // add target and source address
+        _request[1] = ECU_addr;
+        _request[2] = OUR_addr;
+    }
+
+    _request_len = header_len + pid_len + 1; // header + request + checksum
+
+    // add the PID
+    for (uint8_t k = 0; k < pid_len; k++)
+    {
+        _request[header_len + k] = pid[k];
+    }
+
+    // checksum
+    _request[_request_len - 1] = calc_checksum(_request, _request_len - 1);
+
+    // finally we send the request, when nobody else is talking
+    uint8_t collisions = 0;
+    uint8_t sent = false;
+    while (sent == false)
+    {
+        if (waitBusIdle() == false)
+        {
+            return -2;
+        }
+
+        uint16_t echoed = 0; // bytes of the request already compared with their echo
+        sent = true;
+        _elapsed_time = 0;
+        TRACE(TRACE_P3, 0);
+        for (uint16_t i = 0; i < _request_len && sent == true; i++)
+        {
+            _kline->write(_request[i]);
+            TRACE(TRACE_TX, _request[i]);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                if (i == 0)
+                {
+                    _debug->println(F("\nSending\t\tEcho"));
+                }
+                _debug->println(_request[i], HEX);
+            }
+
+            _start_time = KWP2000_MILLIS();
+            while (_elapsed_time < ISO_T_P4_MIN)
+            {
+                _elapsed_time = KWP2000_MILLIS() - _start_time;
+                if (_kline->available() > 0)
+                {
+                    const uint8_t echo = _kline->read();
+                    _last_byte_received = KWP2000_MILLIS();
+                    TRACE(TRACE_RX, echo);
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+                    {
+                        _debug->print("\t\t\t");
+                        _debug->println(echo, HEX);
+                    }
+
+                    // a late echo is compared with its own byte, not with the last one sent
+                    if (echoed > i || echo != _request[echoed])
+                    {
+                        // somebody else is talking: stop here, the ECU drops a frame without its checksum
+                        setError(EE_ECHO);
+                        setError(EE_BUS);
+                        sent = false;
+                        break;
+                    }
+                    echoed++;
+                }
+            }
+            _elapsed_time = 0;
+        }
+        _start_time = 0;
+
+        if (sent == false)
+        {
+            collisions++;
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->print(F("Collision "));
+                _debug->println(collisions);
+            }
+            if (collisions > KWP2000_MAX_COLLISIONS)
+            {
+                return -3;
+            }
+        }
+    }
+
+    if (wait_to_send_all == true)
+    {
+        _kline->flush();
+    }
+    _last_request_sent = KWP2000_MILLIS();
+    TRACE(TRACE_P2, 1);
+
+    if (use_delay == true)
+    {
+        KWP2000_DELAY(ISO_T_P2_MIN);
+    }
+    return true;
+}
+
+/**
+ * @brief Wait until no byte has been received for `_bus_idle` ms, what arrives meanwhile is thrown away
+ * 
+ * @return `true` if the bus is idle, `false` if it has been busy for more than `ISO_T_BUS_BUSY` ms
+ */
+int8_t KWP2000Base::waitBusIdle()
+{
+    const uint32_t start = KWP2000_MILLIS();
+
+    // a byte already in the buffer has an unknown age, it counts as just received
+    while (_kline->available() > 0 || KWP2000_MILLIS() - _last_byte_received < _bus_idle)
+    {
+        if (_kline->available() > 0)
+        {
+            const uint8_t stray = _kline->read();
+            _last_byte_received = KWP2000_MILLIS();
+            TRACE(TRACE_RX, stray);
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->print(F("Bus busy:\t"));
+                _debug->println(stray, HEX);
+            }
+        }
+        if (KWP2000_MILLIS() - start > ISO_T_BUS_BUSY)
+        {
+            setError(EE_BUS);
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Calculate the sensors values from the response in `_response`, 
+ *          it is used by `requestSensorsData()` and by the sniffer
+ */
+void KWP2000Base::decodeSensors()
+{
+    sensors_snapshot previous = {};
+    if (_capture_callback != nullptr)
+    {
+        previous = getSensors();
+    }
+
+#if defined(SUZUKI)
+    //GPS (Gear Position Sensor)
+    _GEAR1 = _response[PID_GPS];
+    _GEAR2 = _response[PID_CLUTCH];
+    _GEAR3 = _response[PID_GEAR_3];
+
+    //RPM (Rights Per Minutes) it is split between two byte
+    _RPM = _response[PID_RPM_H] * 10 + _response[PID_RPM_L] / 10;
+
+    //Speed
+    _SPEED = calibrated(CH_SPEED, _response[PID_SPEED]);
+
+    // the gear needs the RPM and the speed
+    deriveGear(_GEAR1, _GEAR2);
+
+    //TPS (Throttle Position Sensor)
+    if (_flags.throttle_learning == true)
+    {
+        learnThrottleRaw(CH_TPS, _response[PID_TPS]);
+        learnThrottleRaw(CH_STPS, _response[PID_STPS]);
+    }
+    _TPS = calibrated(CH_TPS, _response[PID_TPS]);
+
+    //IAP (Intake Air Pressure)
+    _IAP = calibrated(CH_IAP, _response[PID_IAP]);
+
+    //IAT (Intake Air Temperature)
+    _IAT = calibrated(CH_IAT, _response[PID_IAT]);
+
+    //ECT (Engine Coolant Temperature)
+    _ECT = calibrated(CH_ECT, _response[PID_ECT]);
+
+    //STPS (Secondary Throttle Position Sensor)
+    _STPS = calibrated(CH_STPS, _response[PID_STPS]);
+
+    /*
+    other sensors
+
+    //voltage?
+    voltage = _response[32] * 100 / 126;
+
+    //FUEL 40-46
+
+    //IGN 49-52
+
+    //STVA
+    STVA = _response[54] * 100 / 255;
+
+    //pair
+    PAIR = _response[59];
+    */
+
+#endif
+
+    _last_sensors_calculated = KWP2000_MILLIS();
+
+    if (_capture_callback != nullptr)
+    {
+        captureSensors(previous);
+    }
+
+    if (_sensors_callback != nullptr)
+    {
+        _sensors_callback(getSensors());
+    }
+}
+
+/**
+ * @brief Calculate a channel from its raw value with the constants of `foldCalibration()`
+ * 
+ * @param channel One of the `sensor_channel` from `CH_SPEED`
+ * @param raw The value from the response
+ * @return The value, limited between `0` and `255`
+ */
+uint8_t KWP2000Base::calibrated(const uint8_t channel, const uint8_t raw)
+{
+    const int32_t value = ((int32_t)raw * _calibration_scale[channel - CH_SPEED] + _calibration_offset[channel - CH_SPEED] + 128) / 256;
+    return value < 0 ? 0 : value > 255 ? 255 : value;
+}
+
+/**
+ * @brief Calculate the constants of a channel from its calibration and, for the temperatures, the unit. 
+ *          A calibration not valid yet (e.g. while learning) keeps the old constants
+ * 
+ * @param channel One of the `sensor_channel` from `CH_SPEED`
+ */
+void KWP2000Base::foldCalibration(const uint8_t channel)
+{
+    const calibration_t &calibration = _calibration[channel - CH_SPEED];
+    if (calibration.raw_high <= calibration.raw_low)
+    {
+        return;
+    }
+
+    const int32_t span = calibration.raw_high - calibration.raw_low;
+    int32_t scale = ((int32_t)(calibration.value_high - calibration.value_low) * 256 + span / 2) / span;
+    int32_t offset = (int32_t)calibration.value_low * 256 - (int32_t)calibration.raw_low * scale;
+    if ((channel == CH_IAT || channel == CH_ECT) && _flags.fahrenheit == true)
+    {
+        scale = scale * 9 / 5;
+        offset = offset * 9 / 5 + 32 * 256;
+    }
+    _calibration_scale[channel - CH_SPEED] = scale;
+    _calibration_offset[channel - CH_SPEED] = offset;
+}
+
+/**
+ * @brief Widen the learned calibration of a throttle with a new raw value, the constants change only when 
+ *          the lowest or the highest value change
+ * 
+ * @param channel `CH_TPS` or `CH_STPS`
+ * @param raw The value from the response
+ */
+void KWP2000Base::learnThrottleRaw(const uint8_t channel, const uint8_t raw)
+{
+    calibration_t &calibration = _calibration[channel - CH_SPEED];
+    if (raw >= calibration.raw_low && raw <= calibration.raw_high)
+    {
+        return;
+    }
+
+    if (raw < calibration.raw_low)
+    {
+        calibration.raw_low = raw;
+    }
+    if (raw > calibration.raw_high)
+    {
+        calibration.raw_high = raw;
+    }
+    if (calibration.raw_high >= calibration.raw_low + KWP2000_THROTTLE_SPAN)
+    {
+        foldCalibration(channel);
+    }
+}
+
+/**
+ * @brief Continue learning the throttle calibration from the one saved for this bike, if there is one
+ */
+void KWP2000Base::loadCalibration()
+{
+    calibration_record stored;
+    if (_flags.throttle_learning == false || loadRecord(STORAGE_CALIBRATION, (uint8_t *)&stored, sizeof(stored)) == false ||
+        stored.fingerprint != (_flags.id_valid == true ? _ecu_id.fingerprint : 0))
+    {
+        return;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+    {
+        _debug->println(F("Throttle calibration from the storage"));
+    }
+    _calibration[CH_TPS - CH_SPEED] = stored.tps;
+    _calibration[CH_STPS - CH_SPEED] = stored.stps;
+    if (stored.tps.raw_high >= stored.tps.raw_low + KWP2000_THROTTLE_SPAN)
+    {
+        foldCalibration(CH_TPS);
+    }
+    if (stored.stps.raw_high >= stored.stps.raw_low + KWP2000_THROTTLE_SPAN)
+    {
+        foldCalibration(CH_STPS);
+    }
+}
+
+/**
+ * @brief Save the learned throttle calibration for this bike, at the end of each connection
+ */
+void KWP2000Base::saveCalibration()
+{
+    if (_flags.throttle_learning == false)
+    {
+        return;
+    }
+
+    calibration_record to_store;
+    to_store.fingerprint = _flags.id_valid == true ? _ecu_id.fingerprint : 0;
+    to_store.tps = _calibration[CH_TPS - CH_SPEED];
+    to_store.stps = _calibration[CH_STPS - CH_SPEED];
+    saveRecord(STORAGE_CALIBRATION, (const uint8_t *)&to_store, sizeof(to_store));
+}
+
+/**
+ * @brief Calculate `_GPS`: the gear position sent by the ECU if it sends it, otherwise the gear whose ratio 
+ *          is the nearest to RPM / speed. A new gear replaces the old one only when the ratio is close to it 
+ *          in two snapshots in a row, so the shifts and the clutch slipping don't make it flicker
+ * 
+ * @param gear_byte The gear position from the response: `0` neutral or `1` to `KWP2000_MAX_GEAR`, 
+ *          anything else if the ECU doesn't send it
+ * @param clutch `0` if the clutch is engaged
+ */
+void KWP2000Base::deriveGear(const uint8_t gear_byte, const uint8_t clutch)
+{
+    const uint8_t moving = _SPEED >= KWP2000_GEAR_MIN_SPEED && clutch == 0;
+    const uint32_t rpm_at_100 = moving ? (uint32_t)_RPM * 100 / _SPEED : 0;
+    const uint16_t ratio = rpm_at_100 > 0xFFFF ? 0xFFFF : rpm_at_100;
+
+    if (gear_byte >= 1 && gear_byte <= KWP2000_MAX_GEAR)
+    {
+        _flags.gear_sensor = true;
+    }
+    else if (gear_byte > KWP2000_MAX_GEAR || (moving == true && _flags.gear_sensor == maybe))
+    {
+        // an engaged gear with the bike moving would be in the byte
+        _flags.gear_sensor = false;
+    }
+
+    if (_flags.gear_sensor == true)
+    {
+        _GPS = gear_byte;
+        if (gear_byte != 0 && ratio != 0 && _flags.gear_learning == true && gear_byte <= _gear_ratios + 1)
+        {
+            // the ratios of a bike with the sensor are exact, they are useful only with getGearRatios()
+            _gear_ratio[gear_byte - 1] = _gear_ratio[gear_byte - 1] == 0 ? ratio : _gear_ratio[gear_byte - 1] + ((int32_t)ratio - _gear_ratio[gear_byte - 1]) / 8;
+            if (gear_byte > _gear_ratios)
+            {
+                _gear_ratios = gear_byte;
+            }
+        }
+        return;
+    }
+
+    if (moving == false)
+    {
+        _last_gear_ratio = 0;
+        _gear_pending_count = 0;
+        if (clutch == 0 && _SPEED < KWP2000_GEAR_MIN_SPEED)
+        {
+            _GPS = 0; // the engine is not pulling the bike, a gear can't be known
+        }
+        return; // with the clutch pulled the gear doesn't change
+    }
+
+    // only a steady ratio is a gear, not a shift or a clutch slipping
+    const uint8_t steady = _last_gear_ratio != 0 && ratio < _last_gear_ratio + _last_gear_ratio / 32 && ratio + _last_gear_ratio / 32 > _last_gear_ratio;
+    _last_gear_ratio = ratio;
+    if (steady == true && _flags.gear_learning == true)
+    {
+        learnGearRatio(ratio);
+    }
+
+    // nearest gear within 10%, a new one must be within 5%
+    uint8_t nearest = 0;
+    uint16_t nearest_distance = 0xFFFF;
+    for (uint8_t g = 0; g < _gear_ratios; g++)
+    {
+        const uint16_t distance = ratio > _gear_ratio[g] ? ratio - _gear_ratio[g] : _gear_ratio[g] - ratio;
+        if (distance < nearest_distance)
+        {
+            nearest = g + 1;
+            nearest_distance = distance;
+        }
+    }
+    if (nearest == 0 || nearest_distance > _gear_ratio[nearest - 1] / 10)
+    {
+        _gear_pending_count = 0;
+        return; // between two gears, keep the last one
+    }
+    if (nearest == _GPS || nearest_distance > _gear_ratio[nearest - 1] / 20)
+    {
+        _gear_pending_count = 0;
+        return;
+    }
+    if (nearest != _gear_pending)
+    {
+        _gear_pending = nearest;
+        _gear_pending_count = 0;
+    }
+    if (++_gear_pending_count >= 2)
+    {
+        _GPS = nearest;
+        _gear_pending_count = 0;
+    }
+}
 
 /**
- * @brief Print a rich and useful set of information about the ECU status and errors
+ * @brief Learn the gear ratios of a bike without the gear position: a steady ratio within 6% of a known one 
+ *          corrects it, otherwise it is a new gear. The gears are numbered from the highest ratio seen
  * 
- * @param time Optional, default to `2000`milliseconds. The time between one print and the other
+ * @param ratio RPM at 100 km/h
  */
-void KWP2000::printStatus(uint16_t time)
+void KWP2000Base::learnGearRatio(const uint16_t ratio)
 {
-    if (time == false)
+    for (uint8_t g = 0; g < _gear_ratios; g++)
     {
-        // skip
-        return;
+        const uint16_t distance = ratio > _gear_ratio[g] ? ratio - _gear_ratio[g] : _gear_ratio[g] - ratio;
+        if (distance <= _gear_ratio[g] / 16)
+        {
+            _gear_ratio[g] += ((int32_t)ratio - _gear_ratio[g]) / 16;
+            return;
+        }
     }
 
-    if (millis() - _last_status_print <= time)
+    if (_gear_ratios == KWP2000_MAX_GEAR)
     {
-        // not enough time has passed since last time we printed the status
-        return;
+        return; // all the gears are known, it is a glitch
     }
 
-    if (_debug_enabled == true)
+    // keep them sorted: the first gear has the highest ratio
+    uint8_t g = _gear_ratios++;
+    while (g > 0 && _gear_ratio[g - 1] < ratio)
     {
-        _debug->print(F("\n---- STATUS ----\n"));
-        _debug->print(F("Connection:\t\t"));
-        _debug->println(_ECU_status == 1 ? "Connected" : "Not connected");
-        _debug->print(F("Errors:\t\t\t"));
-        _debug->println(_ECU_error == 0 ? "No" : "Yes");
+        _gear_ratio[g] = _gear_ratio[g - 1];
+        g--;
+    }
+    _gear_ratio[g] = ratio;
 
-        if (_last_correct_response != 0)
-        {
-            _debug->print(F("Last data:\t\t"));
-            _debug->print((millis() - _last_correct_response) / 1000.0);
-            _debug->print(F(" seconds ago"));
-        }
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+    {
+        _debug->print(F("New gear ratio: "));
+        _debug->print(ratio);
+        _debug->println(F(" RPM at 100 km/h"));
+    }
+}
 
-        if (_connection_time != 0)
+/**
+ * @brief Find who sent the frame in `_response` captured by `sniff()`, give it to the callback and decode the sensors
+ */
+void KWP2000Base::snifferFrame()
+{
+    uint8_t direction;
+    if ((_response[0] & 0xC0) != 0)
+    {
+        // the testers use the addresses from F0 to FD
+        direction = _response[2] >= 0xF0 && _response[2] <= 0xFD ? FRAME_REQUEST : FRAME_RESPONSE;
+    }
+    else
+    {
+        // all the responses have the 0x40 bit of the SID
+        direction = (_response[_response_data_start] & 0x40) != 0 ? FRAME_RESPONSE : FRAME_REQUEST;
+    }
+
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+    {
+        _debug->print(direction == FRAME_REQUEST ? F("REQ") : F("RSP"));
+        for (uint16_t n = 0; n < _response_len; n++)
         {
-            _debug->print(F("Connection time:"));
-            _debug->print((millis() - _connection_time) / 1000.0);
-            _debug->println(" seconds ago");
+            _debug->print(' ');
+            _debug->print(_response[n], HEX);
         }
+        _debug->println();
+    }
+
+    if (_frame_callback != nullptr)
+    {
+        _frame_callback(KWP2000_MILLIS(), direction, _response, _response_len + 1);
+    }
 
-        _debug->print(F("Baudrate:\t\t"));
-        _debug->println(_kline_baudrate);
-        _debug->print(F("K-line TX pin:\t"));
-        _debug->println(_k_out_pin);
 #if defined(SUZUKI)
-        _debug->print(F("Dealer pin:\t\t"));
-        _debug->println(_dealer_pin);
-        _debug->print(F("Dealer mode:\t"));
-        _debug->println(_dealer_mode == 1 ? "Enabled" : "Disabled");
+    if (direction == FRAME_RESPONSE && _response[_response_data_start] == request_ok(request_sens[0]) &&
+        _response[_response_data_start + 1] == request_sens[1] && _response_len > PID_GEAR_3)
+    {
+        // the tester asked the same sensors we ask
+        decodeSensors();
+    }
 #endif
-        //other stuff?
-        if (_ECU_error != 0)
+}
+
+/**
+ * @brief Translate the negative response to a security access request in the values returned by `securityAccess()`
+ * 
+ * @return `-3` if the ECU asks to wait, `-4` if the key was wrong, `-2` otherwise
+ */
+int8_t KWP2000Base::securityRejected()
+{
+    switch (_last_nrc)
+    {
+    case 0x36: // exceedNumberOfAttempts, the ECU starts the delay
+    case 0x37: // requiredTimeDelayNotExpired
+        _security_delay_end = KWP2000_MILLIS() + KWP2000_SECURITY_DELAY;
+        if (_security_delay_end == 0)
         {
-            _debug->print(F("\n---- ERRORS ----\n"));
-            for (uint8_t i = 0; i < EE_TOTAL; i++)
-            {
-                if (bitRead(_ECU_error, i) != 0)
-                {
-                    switch (i)
-                    {
-                    case EE_USER:
-                        _debug->println(F("We called some function in a wrong way"));
-                        break;
-                    case EE_START:
-                        _debug->println(F("Unable to start comunication"));
-                        break;
-                    case EE_STOP:
-                        _debug->println(F("Unable to stop comunication"));
-                        break;
-                    case EE_TO:
-                        _debug->println(F("Data is not for us"));
-                        break;
-                    case EE_FROM:
-                        _debug->println(F("Data don't came from the ECU"));
-                        break;
-                    case EE_CS:
-                        _debug->println(F("Checksum error"));
-                        break;
-                    case EE_ECHO:
-                        _debug->println(F("Echo error"));
-                        break;
-                    case EE_UNEX:
-                        _debug->println(F("Unexpected error"));
-                        break;
-                    case EE_HEADER:
-                        _debug->println(F("Unexpected header"));
-                        break;
-                    case EE_CONFIG:
-                        _debug->println(F("The key bytes are probably wrong"));
-                        break;
-                    case EE_P3MAX:
-                        _debug->println(F("Time out of the communication"));
-                        break;
-                    case EE_CR:
-                        _debug->println(F("Check response error"));
-                        break;
-                    case EE_ATP:
-                        _debug->println(F("Problem setting the timing parameter"));
-                        break;
-                    case EE_WR:
-                        _debug->println(F("We get a reject for a request we didn't sent"));
-                        break;
-                    case EE_US:
-                        _debug->println(F("Unsupported, yet"));
-                        break;
-                    default:
-                        _debug->print(F("Did I forget any enum?"));
-                        _debug->println(i);
-                        break;
-                    }
-                }
-            }
+            _security_delay_end = 1; // 0 means no delay
         }
-        _debug->print(F("---- ------- ----\n\n"));
-        _last_status_print = millis();
+        return -3;
+    case 0x35: // invalidKey
+        return -4;
+    default:
+        return -2;
     }
-    else
+}
+
+/**
+ * @brief Ask one identification option to the ECU and copy it in its field of `_ecu_id`, 
+ *          the characters that can't be printed are replaced by a `.`
+ * 
+ * @param option One of the `id_` options from PIDs.h
+ * @return `true` if the ECU sent it, a `negative number` otherwise
+ */
+int8_t KWP2000Base::readIdentificationOption(const uint8_t option)
+{
+    char *field;
+    uint8_t field_len;
+
+    switch (option)
     {
+    case id_vin:
+        field = _ecu_id.vin;
+        field_len = sizeof(_ecu_id.vin) - 1;
+        break;
+    case id_part_number:
+        field = _ecu_id.part_number;
+        field_len = KWP2000_ID_LEN;
+        break;
+    case id_hardware_number:
+        field = _ecu_id.hardware_number;
+        field_len = KWP2000_ID_LEN;
+        break;
+    case id_software_number:
+        field = _ecu_id.software_number;
+        field_len = KWP2000_ID_LEN;
+        break;
+    case id_system_name:
+        field = _ecu_id.system_name;
+        field_len = KWP2000_ID_LEN;
+        break;
+    default:
         setError(EE_USER);
+        return -1;
+    }
+
+    const uint8_t to_send[] = {ecu_identification[0], option};
+    if (handleRequest(to_send, LEN(to_send), true) != true || _response[_response_data_start + 1] != option)
+    {
+        return -2;
+    }
+
+    uint8_t n = 0;
+    for (uint16_t i = _response_data_start + 2; i < _response_len && n < field_len; i++)
+    {
+        const uint8_t c = _response[i];
+        field[n++] = (c >= 0x20 && c < 0x7F) ? c : '.';
     }
+    while (n > 0 && (field[n - 1] == ' ' || field[n - 1] == '.'))
+    {
+        n--; // padding
+    }
+    field[n] = 0;
+    return true;
 }
 
 /**
- * @brief Print all the sensors data from the ECU, you need to run `requestSensorsData()` before
+ * @brief Choose the line config of the next `initKline()`: the stored one, then the candidates of `enableAutoBaud()`
+ * 
+ * @return `true` if there is another line config to try in this round, `false` if all of them have been tried
  */
-void KWP2000::printSensorsData()
+uint8_t KWP2000Base::selectLineConfig()
 {
-    if (_last_sensors_calculated == 0)
+    line_config_t stored;
+    line_config_t first = _line_default;
+    if (loadRecord(STORAGE_LINE, (uint8_t *)&stored, sizeof(stored)) == true)
     {
-        // we didn't run requestSensorsData
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        first = stored; // the one of the last ECU connected
+    }
+
+    if (_line_next == 0)
+    {
+        _line_next = 1;
+        _kline_baudrate = first.baudrate;
+        _kline_config = first.config;
+        return true;
+    }
+
+    while (_line_next <= _line_candidates_len)
+    {
+        const line_config_t &candidate = _line_candidates[_line_next - 1];
+        _line_next++;
+        if (candidate.baudrate != first.baudrate || candidate.config != first.config)
         {
-            _debug->print(F("requestSensorsData need to be called before"));
+            _kline_baudrate = candidate.baudrate;
+            _kline_config = candidate.config;
+            return true;
         }
-        setError(EE_USER);
+    }
+    return false;
+}
+
+/**
+ * @brief Read a record written by `saveRecord()`
+ * 
+ * @param offset Where the record is, from the address given to `enableStorage()`
+ * @param data Where the record will be copied, it is changed even if the record is not valid
+ * @param len The lenght of the record
+ * @return `true` if the record is valid, `false` if it is not or the storage is not enabled
+ */
+uint8_t KWP2000Base::loadRecord(const uint16_t offset, uint8_t data[], const uint16_t len)
+{
+    if (_storage_read == nullptr)
+    {
+        return false;
+    }
+
+    uint8_t header[2]; // magic and checksum
+    _storage_read(_storage_address + offset, header, 2);
+    if (header[0] != STORAGE_MAGIC)
+    {
+        return false;
+    }
+    _storage_read(_storage_address + offset + 2, data, len);
+    return header[1] == calc_checksum(data, len);
+}
+
+/**
+ * @brief Write a record to the storage, if it is enabled. Nothing is written if the record didn't change
+ * 
+ * @param offset Where the record is, from the address given to `enableStorage()`
+ * @param data The record
+ * @param len The lenght of the record
+ */
+void KWP2000Base::saveRecord(const uint16_t offset, const uint8_t data[], const uint16_t len)
+{
+    if (_storage_write == nullptr || _storage_read == nullptr)
+    {
         return;
     }
 
-    if (_debug_enabled == true)
+    uint8_t header[2] = {STORAGE_MAGIC, calc_checksum(data, len)};
+    uint8_t stored[8];
+    _storage_read(_storage_address + offset, stored, 2);
+    uint8_t same = stored[0] == header[0] && stored[1] == header[1];
+
+    // the checksum is the same for many records, only the bytes tell if it changed. A few at a time, on the stack
+    for (uint16_t n = 0; n < len && same == true; n += sizeof(stored))
     {
-        _debug->print(F("---- SENSORS ----\n"));
-        _debug->print(F("Calculated: "));
-        _debug->print(_last_sensors_calculated == 0 ? "Never\n"
-                                                    : String((millis() - _last_sensors_calculated) / 1000.0, 2) + " seconds ago\n");
-        _debug->print(F("GPS:\t"));
-        _debug->println(_GPS);
-        _debug->print(F("RPM:\t"));
-        _debug->println(_RPM);
-        _debug->print(F("Speed:\t"));
-        _debug->println(_SPEED);
-        _debug->print(F("TPS:\t"));
-        _debug->println(_TPS);
-        _debug->print(F("IAP:\t"));
-        _debug->println(_IAP);
-        _debug->print(F("IAT:\t"));
-        _debug->println(_IAT);
-        _debug->print(F("ECT:\t"));
-        _debug->println(_ECT);
-        _debug->print(F("STPS:\t"));
-        _debug->println(_STPS);
-        //_debug->print(F(":\t"));_debug->println();
+        const uint16_t chunk = len - n < (uint16_t)sizeof(stored) ? len - n : sizeof(stored);
+        _storage_read(_storage_address + offset + 2 + n, stored, chunk);
+        for (uint16_t i = 0; i < chunk; i++)
+        {
+            if (stored[i] != data[n + i])
+            {
+                same = false;
+                break;
+            }
+        }
+    }
+    if (same == true)
+    {
+        return;
+    }
+    _storage_write(_storage_address + offset + 2, data, len);
+    _storage_write(_storage_address + offset, header, 2);
+}
 
-        _debug->print(F("_GEAR1:\t"));
-        _debug->println(_GEAR1, BIN);
-        _debug->print(F("_GEAR2:\t"));
-        _debug->println(_GEAR2, BIN);
-        _debug->print(F("_GEAR3:\t"));
-        _debug->println(_GEAR3, BIN);
+/**
+ * @brief A long list of DTC can be split in more responses: if the first one has more DTC than the records received 
+ *          the others are coming, they are added to the responses until P2 max
+ */
+void KWP2000Base::listenTroubleCodes()
+{
+    const uint8_t record_len = getResponseData()[0] == request_ok(trouble_codes_all[0]) ? 2 : 3;
+    uint16_t records = 0;
+    for (uint8_t f = 0; f < _frames_count; f++)
+    {
+        if (getResponseLength(f) >= 2 && getResponseData(f)[0] == getResponseData()[0])
+        {
+            records += (getResponseLength(f) - 2) / record_len;
+        }
+    }
+    if (getResponseLength() >= 2 && getResponseData()[1] > records && records < KWP2000_MAX_DTC && _frames_count < KWP2000_MAX_FRAMES)
+    {
+        listenResponse(true, ISO_T_P2_MAX, true);
+    }
+}
 
-        _debug->print(F("---- ------- ----\n"));
-        _last_data_print = millis();
+/**
+ * @brief Decode the DTC from the last responses and keep them in `_dtc`. 
+ *          The records are two bytes of code and, except for `READ_TOTAL`, one byte of status. 
+ *          A long list can be split in more responses: each one has its number of DTC, or the first one has the total
+ * 
+ * @return `true` if a DTC appeared or has been cleared, or if it is the first read of the connection, `false` otherwise
+ */
+uint8_t KWP2000Base::parseTroubleCodes()
+{
+    const uint8_t SID = _response[_response_data_start];
+    const uint8_t record_len = SID == request_ok(trouble_codes_all[0]) ? 2 : 3;
+    dtc_t old_dtc[KWP2000_MAX_DTC];
+    const uint8_t was_valid = _flags.dtc_valid;
+    const uint8_t old_stored = was_valid == true ? _dtc_stored : 0;
+    const uint8_t old_total = _dtc_total;
+
+    for (uint8_t i = 0; i < old_stored; i++)
+    {
+        old_dtc[i] = _dtc[i];
     }
-    else
+
+    // the total is in the first response if it has more DTC than the records it contains
+    const uint8_t first_total = _response[_response_data_start + 1];
+    const uint8_t total_in_first = _frames_count > 1 && first_total > (_response_len - _response_data_start - 2) / record_len;
+    _dtc_total = 0;
+    _dtc_stored = 0;
+    for (uint8_t f = 0; f < _frames_count || f == 0; f++)
     {
-        setError(EE_USER);
+        const uint16_t start = f == 0 ? _response_data_start : _frames[f].data_start;
+        const uint16_t end = f == 0 ? _response_len : _frames[f].len;
+        if (end < start + 2 || _response[start] != SID)
+        {
+            continue; // not part of the list
+        }
+
+        const uint8_t frame_total = _response[start + 1];
+        if (total_in_first == false)
+        {
+            _dtc_total += frame_total;
+        }
+        uint16_t n = start + 2;
+        uint8_t read = 0;
+        while (n + record_len <= end && read < frame_total && _dtc_stored < KWP2000_MAX_DTC)
+        {
+            _dtc[_dtc_stored].code = _response[n] << 8 | _response[n + 1];
+            _dtc[_dtc_stored].status = record_len == 3 ? _response[n + 2] : 0;
+            _dtc_stored++;
+            read++;
+            n += record_len;
+        }
+    }
+    if (total_in_first == true)
+    {
+        _dtc_total = first_total;
+    }
+    _flags.dtc_valid = true;
+    _flags.dtc_stale = false;
+
+    // the first read of the session finds the old DTC, they are not an event
+    uint8_t appeared = false;
+    for (uint8_t i = 0; i < _dtc_stored; i++)
+    {
+        if (findTroubleCode(old_dtc, old_stored, _dtc[i].code) == false)
+        {
+            appeared = true;
+            if (_dtc_callback != nullptr && was_valid == true)
+            {
+                _dtc_callback(_dtc[i], true);
+            }
+        }
+    }
+    uint8_t cleared = false;
+    for (uint8_t i = 0; i < old_stored; i++)
+    {
+        if (findTroubleCode(_dtc, _dtc_stored, old_dtc[i].code) == false)
+        {
+            cleared = true;
+            if (_dtc_callback != nullptr)
+            {
+                _dtc_callback(old_dtc[i], false);
+            }
+        }
+    }
+
+    for (uint8_t t = 0; t < _triggers_count && appeared == true && was_valid == true; t++)
+    {
+        if (_triggers[t].type == TRIGGER_NEW_DTC)
+        {
+            fireTrigger(t, getSensors());
+            break;
+        }
     }
+
+    // the DTC beyond KWP2000_MAX_DTC are only in the total
+    return was_valid == false || appeared == true || cleared == true || _dtc_total != old_total;
 }
 
 /**
- * @brief Print the last response received from the ECU
+ * @brief Search a DTC in a list
+ * 
+ * @param list The DTC list
+ * @param list_len The lenght of the list
+ * @param code The code to search
+ * @return `true` if the code is in the list, `false` otherwise
  */
-void KWP2000::printLastResponse()
+uint8_t KWP2000Base::findTroubleCode(const dtc_t list[], const uint8_t list_len, const uint16_t code)
 {
-    if (_debug_enabled == true)
+    for (uint8_t i = 0; i < list_len; i++)
     {
-        _debug->println(F("Last Response from the ECU:"));
-        for (uint8_t n = 0; n < _response_len; n++)
+        if (list[i].code == code)
         {
-            _debug->println(_response[n], HEX);
+            return true;
         }
     }
-    else
-    {
-        setError(EE_USER);
-    }
+    return false;
 }
 
 /**
- * @brief Get the connection status
+ * @brief Count a request of `update()` in the scheduler stats
  * 
- * @return It could be `true` or `false`
+ * @param deadline When it should have been completed
  */
-int8_t KWP2000::getStatus()
+void KWP2000Base::scheduled(const uint32_t deadline)
 {
-    return _ECU_status;
+    _scheduler_stats.completed++;
+    const int32_t lateness = KWP2000_MILLIS() - deadline;
+    if (lateness > 0)
+    {
+        _scheduler_stats.missed++;
+        if ((uint32_t)lateness > _scheduler_stats.worst_lateness)
+        {
+            _scheduler_stats.worst_lateness = lateness;
+        }
+    }
 }
 
 /**
- * @brief This say you only if there are/aren't errors, to see them use `printStatus()`
+ * @brief Check if `update()` can spend some time on the DTC
  * 
- * @return It could be `true` or `false`
+ * @param now The actual time
+ * @return `true` if the interval passed, there is enough time before the next sensors request (or we waited too long for it) 
+ *          and the bus share is not exceeded
  */
-int8_t KWP2000::getError()
+uint8_t KWP2000Base::troubleCodesDue(const uint32_t now)
 {
-    if (_ECU_error == 0)
+    if (_dtc_interval == 0 || _flags.capturing == true)
     {
-        return 1;
+        return false;
     }
-    else
+    if (_flags.dtc_stale == true)
     {
-        return -1;
+        return true; // e.g. cleared: the callback tells which ones at once
+    }
+    if (now - _last_dtc_poll < _dtc_interval)
+    {
+        return false;
     }
-}
 
-/**
- * @brief Reset the errors from the ECU, use with caution
- */
-void KWP2000::resetError()
-{
-    _ECU_error = 0;
+    if (_sensors_interval != 0 && now - _last_sensors_request + _dtc_poll_time > _sensors_interval &&
+        now - _last_dtc_poll < 2 * (uint32_t)_dtc_interval)
+    {
+        // it would delay the next sensors request, wait for a gap but not more than another interval
+        return false;
+    }
+
+    uint32_t window = now - _dtc_window_start;
+    if (window > 60000)
+    {
+        // older checks weigh less and less
+        _dtc_window_start += window / 2;
+        _dtc_bus_time /= 2;
+        window -= window / 2;
+    }
+    return _dtc_bus_time * 100 <= (uint32_t)_dtc_max_share * window;
 }
 
 /**
- * @brief Get* the ECU sensor value you need
- * GPS: Gear Position Sensor
- * RPM: Right Per Minutes
- * SPEED: speed of the bike
- * TPS: Throttle Position Sensor
- * IAP: Intake Air Pressure
- * IAT: Intake Air Temperature
- * ECT: Engine Coolant Temperature
- * STPS: Secondary Throttle Position Sensor
- * @return The sensor value from the ECU
+ * @brief Print the DTC kept in `_dtc`, with the ISO 15031-6 code (P, C, B, U) and the status
  */
-uint8_t KWP2000::getGPS()
-{
-    return _GPS;
-}
-
-uint8_t KWP2000::getRPM()
-{
-    return _RPM;
-}
-
-uint8_t KWP2000::getSPEED()
-{
-    return _SPEED;
-}
-
-uint8_t KWP2000::getTPS()
-{
-    return _TPS;
-}
-
-uint8_t KWP2000::getIAP()
-{
-    return _IAP;
-}
-
-uint8_t KWP2000::getIAT()
+void KWP2000Base::printTroubleCodes()
 {
-    return _IAT;
-}
-
-uint8_t KWP2000::getECT()
-{
-    return _ECT;
-}
-
-uint8_t KWP2000::getSTPS()
-{
-    return _STPS;
+    _debug->print(F("There are "));
+    _debug->print(_dtc_total);
+    _debug->println(F(" errors"));
+    for (uint8_t i = 0; i < _dtc_stored; i++)
+    {
+        _debug->print("PCBU"[_dtc[i].code >> 14]);
+        _debug->print((_dtc[i].code >> 12) & 0x3);
+        for (int8_t shift = 8; shift >= 0; shift -= 4)
+        {
+            _debug->print((_dtc[i].code >> shift) & 0xF, HEX);
+        }
+        _debug->print(F("\tstatus: 0x"));
+        _debug->println(_dtc[i].status, HEX);
+    }
+    _debug->println();
 }
 
-/////////////////// PRIVATE ///////////////////////
-
 /**
- * @brief Generate and send a request to the ECU
+ * @brief Calculate the lenght of the header that `sendRequest()` will put before the PID
  * 
- * @param pid The PID you want to send
- * @param pid_len the lenght of the PID, get it with `sizeof()` 
- * @param wait_to_send_all Choose to wait untill the tx buffer is empty
- * @param use_delay Choose to wait at the end of the function or to do other tasks
+ * @param pid_len The lenght of the PID
+ * @return The lenght of the header
  */
-void KWP2000::sendRequest(const uint8_t pid[], const uint8_t pid_len, const uint8_t wait_to_send_all, const uint8_t use_delay)
+uint8_t KWP2000Base::requestHeaderLength(const uint8_t pid_len)
 {
-    uint8_t echo = 0;
-    uint8_t header_len = 1; // minimun lenght
-
-    // create the request
-    // make the header
-    if (_use_lenght_byte == true)
-    {
-        //we use the lenth byte
-        _request[0] = format_physical;
-        _request[3] = pid_len;
-        header_len += 1;
-    }
-    else // don't use the lenght_byte
+    if (pid_len >= 64 && (_link.layout == LAYOUT_FMT || _link.layout == LAYOUT_FMT_ADDR))
     {
-        if (pid_len >= 64)
-        {
-            // we are forcet to use the lenght byte
-            _request[0] = format_physical;
-            _request[3] = pid_len;
-            header_len += 1;
-        }
-        else
-        {
-            // the lenght byte is "inside" the format
-            _request[0] = format_physical | pid_len;
-        }
+        // the lenght doesn't fit in the format byte, a lenght byte is added
+        return _link.header_len + 1;
     }
+    return _link.header_len;
+}
 
-    if (_use_target_source_address == true)
+/**
+ * @brief Calculate the layout and the header lenght of our requests from the link configuration, 
+ *          it is called only when the configuration changes
+ */
+void KWP2000Base::updateLayout()
+{
+    if (_link.addresses == true)
     {
-        // add target and source address
-        _request[1] = ECU_addr;
-        _request[2] = OUR_addr;
-        header_len += 2;
+        _link.layout = _link.length_byte == true ? LAYOUT_FMT_ADDR_LEN : LAYOUT_FMT_ADDR;
     }
-
-    _request_len = header_len + pid_len + 1; // header + request + checksum
-
-    // add the PID
-    for (uint8_t k = 0; k < pid_len; k++)
+    else
     {
-        _request[header_len + k] = pid[k];
+        _link.layout = _link.length_byte == true ? LAYOUT_FMT_LEN : LAYOUT_FMT;
     }
+    _link.header_len = layout_header_len[_link.layout];
+}
 
-    // checksum
-    _request[_request_len - 1] = calc_checksum(_request, _request_len - 1);
+/**
+ * @brief Find the layout of a response from its format byte, the `maybe` link configuration is solved by the first response
+ * 
+ * @param format The first byte of the response
+ * @return One of the `frame_layout`
+ */
+uint8_t KWP2000Base::responseLayout(const uint8_t format)
+{
+    const uint8_t length_byte = (format & 0x3F) == 0; // otherwise the lenght is inside the format byte
 
-    // finally we send the request
-    _elapsed_time = 0;
-    for (uint8_t i = 0; i < _request_len; i++)
+    if (_link.addresses == maybe || _link.length_byte == maybe)
     {
-        _kline->write(_request[i]);
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-        {
-            if (i == 0)
-            {
-                _debug->println(F("\nSending\t\tEcho"));
-            }
-            _debug->println(_request[i], HEX);
-        }
-
-        _start_time = millis();
-        while (_elapsed_time < ISO_T_P4_MIN)
+        // it will use the same configuration as in the first response
+        if (_link.addresses == maybe)
         {
-            _elapsed_time = millis() - _start_time;
-            if (_kline->available() > 0)
-            {
-                echo = _kline->read();
-                _debug->print("\t\t\t");
-                _debug->println(echo, HEX);
-            }
+            _link.addresses = (format & 0xC0) != 0;
         }
-        _elapsed_time = 0;
-
-        //check if i send the correct bytes
-        if (echo != _request[i] && echo != 0)
+        if (_link.length_byte == maybe)
         {
-            setError(EE_ECHO);
+            _link.length_byte = length_byte;
         }
-    }
-    _start_time = 0;
-
-    if (wait_to_send_all == true)
-    {
-        _kline->flush();
+        setError(EE_TEST);
+        updateLayout();
     }
 
-    if (use_delay == true)
+    if (_link.addresses == true)
     {
-        delay(ISO_T_P2_MIN);
+        return length_byte == true ? LAYOUT_FMT_ADDR_LEN : LAYOUT_FMT_ADDR;
     }
+    return length_byte == true ? LAYOUT_FMT_LEN : LAYOUT_FMT;
 }
 
 /**
- * @brief Listen and process the response from the ECU
+ * @brief Listen and process the responses from the ECU: after each one it keeps listening for another one until P3 min 
+ *          (P2 max with `collectResponses()`), and after a response pending (0x78) it waits the real response until P3 max
  * 
  * @param use_delay Choose to wait at the end of the function or to do other tasks
+ * @param timeout Optional, default to `0`. Maximum time without bytes from the ECU, `0` means P3 max
+ * @param more Optional, default to `false`. With `true` the responses already received are kept and the new ones are added
  */
-void KWP2000::listenResponse(const uint8_t use_delay)
+void KWP2000Base::listenResponse(const uint8_t use_delay, uint32_t timeout, const uint8_t more)
 {
-    // reset _response
-    _response_data_start = 0;
-    _response_len = 0;
-    for (uint16_t i = 0; i < ISO_MAX_DATA; i++)
+    if (timeout == 0)
+    {
+        timeout = ISO_T_P3_mdf;
+    }
+
+    uint16_t frame_start = 0; // where the response being received starts in _response
+    if (more == true && _frames_count > 0)
+    {
+        frame_start = _frames[_frames_count - 1].len + 1;
+    }
+    else
     {
-        _response[i] = 0;
+        // reset _response
+        _response_data_start = 0;
+        _response_len = 0;
+        _frames_count = 0;
+        _last_nrc = 0;
+        for (uint16_t i = 0; i < _response_size; i++)
+        {
+            _response[i] = 0;
+        }
     }
 
     uint8_t masked = 0;                     // useful for bit mask operation
     uint8_t response_completed = false;     // when true no more bytes will be received
     uint32_t incoming;                      // incoming byte from the ECU
-    uint8_t n_byte = 0;                     // actual lenght of the response, updated every times a new byte is received
+    uint16_t n_byte = frame_start;          // actual lenght of the responses, updated every times a new byte is received
+    uint16_t data_start = frame_start;      // where the data of this response starts
+    uint8_t layout = LAYOUT_FMT;            // layout of this response, found from the format byte
+    uint8_t header_len = 1;                 // lenght of the header of this response
     uint8_t data_to_rcv = 0;                // data to receive: bytes of the response that have to be received (not received yet)
     uint8_t data_rcvd = 0;                  // data received: bytes of the response already received
-    uint32_t last_data_received = millis(); // check times for the timeout
+    uint32_t last_data_received = KWP2000_MILLIS(); // check times for the timeout
 
-    while ((millis() - last_data_received < ISO_T_P3_mdf) && (response_completed == false))
+    while ((KWP2000_MILLIS() - last_data_received < timeout) && (response_completed == false))
     {
         if (_kline->available() > 0)
         {
             incoming = _kline->read();
+            _last_byte_received = KWP2000_MILLIS();
+            TRACE(TRACE_RX, incoming);
+            if (n_byte == 0)
+            {
+                TRACE(TRACE_P2, 0);
+            }
+            if (n_byte >= _response_size)
+            {
+                // the response doesn't fit in the buffer, see KWP2000Sized
+                if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+                {
+                    _debug->println(F("\nResponse too long for the buffer"));
+                }
+                setError(EE_BUFFER);
+                if (_frames_count == 0)
+                {
+                    _response[0] = 0;
+                }
+                // the responses already completed are kept
+                n_byte = frame_start;
+                break;
+            }
             _response[n_byte] = incoming;
+            const uint16_t position = n_byte - frame_start; // inside this response
 
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
-                if (n_byte == 0)
+                if (position == 0)
                 {
                     _debug->print(F("\nReceiving:"));
                 }
@@ -1371,27 +3802,25 @@ void KWP2000::listenResponse(const uint8_t use_delay)
                 _debug->print(incoming, HEX);
             }
 
-            last_data_received = millis(); // reset the timer for each byte received
+            last_data_received = KWP2000_MILLIS(); // reset the timer for each byte received
 
             // delay(ISO_T_P1);
             // Technically the ECU waits between 0 to 20 ms between sending two bytes
             // We use this time to analyze what we received
 
-            switch (n_byte)
+            if (position == 0) // the first byte is the formatter, with or without lenght bits
             {
-            case 0: // the first byte is the formatter, with or without lenght bits
-
                 masked = incoming & 0xC0; // 0b11000000
                 if (masked == format_physical)
                 {
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
                         _debug->print(F("\t- format physical"));
                     }
                 }
                 else if (masked == format_functional)
                 {
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
                         _debug->print(F("\t- format functional"));
                     }
@@ -1399,7 +3828,7 @@ void KWP2000::listenResponse(const uint8_t use_delay)
                 }
                 else if (masked == format_CARB)
                 {
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
                         _debug->print(F("\t- format CARB"));
                     }
@@ -1407,68 +3836,48 @@ void KWP2000::listenResponse(const uint8_t use_delay)
                 }
                 else
                 {
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
                         _debug->print(F("\t- unexpected header"));
                     }
                     setError(EE_HEADER);
                 }
 
-                // let's see if there are lenght bits
-                if (_use_lenght_byte == true || _use_lenght_byte == maybe)
+                // from now on only the layout is used to know the meaning of the next bytes
+                layout = responseLayout(incoming);
+                header_len = layout_header_len[layout];
+                data_to_rcv = incoming & 0x3F; // 0b00111111, zero if there is the lenght byte
+                if (data_to_rcv != 0 && DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                 {
-                    masked = incoming & 0x3F; // 0b00111111
-                    if (masked != 0)          // the response lengh is inside the formatter
-                    {
-                        data_to_rcv = masked;
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                        {
-                            _debug->print(F("\t- "));
-                            _debug->print(data_to_rcv);
-                            _debug->print(F(" data bytes coming"));
-                        }
-
-                        if (_use_lenght_byte == maybe)
-                        {
-                            _use_lenght_byte = false;
-                            setError(EE_TEST);
-                        }
-                    }
-                    else // the response lenght is in a separete byte (the 2nd or the 4th)
-                    {
-                        data_to_rcv = 0;
-                    }
+                    _debug->print(F("\t- "));
+                    _debug->print(data_to_rcv);
+                    _debug->print(F(" data bytes coming"));
                 }
-                break;
-
-            case 1: // the second byte is be the target address or the lenght byte or the data
-
-                if (_use_target_source_address == maybe)
+            }
+            else if (position < header_len) // target address, source address or lenght byte
+            {
+                if (position == header_len - 1 && (layout == LAYOUT_FMT_LEN || layout == LAYOUT_FMT_ADDR_LEN))
                 {
-                    if (incoming == OUR_addr)
-                    {
-                        _use_target_source_address = true;
-                        setError(EE_TEST);
-                    }
-                    else
+                    data_to_rcv = incoming;
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
-                        _use_target_source_address = false;
-                        setError(EE_TEST);
+                        _debug->print(F("\t- "));
+                        _debug->print(data_to_rcv);
+                        _debug->print(F(" data bytes coming"));
                     }
                 }
-
-                if (_use_target_source_address == true)
+                else if (position == 1) // target address
                 {
-                    if (incoming == OUR_addr) // it is the target byte
+                    if (incoming == OUR_addr)
                     {
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                         {
                             _debug->print(F("\t- ECU is communicating with us"));
                         }
                     }
                     else
                     {
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                         {
                             // (I'm not jealous it's just curiosity :P)
                             _debug->print(F("\t- ECU is communicating with this address"));
@@ -1476,47 +3885,18 @@ void KWP2000::listenResponse(const uint8_t use_delay)
                         setError(EE_TO);
                     }
                 }
-                else if (_use_target_source_address == false)
-                {
-                    if (data_to_rcv == 0) // it is the lenght byte
-                    {
-                        data_to_rcv = incoming;
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                        {
-                            _debug->print(F("\t- "));
-                            _debug->print(data_to_rcv);
-                            _debug->print(F(" data bytes coming"));
-                        }
-                    }
-                    else // data
-                    {
-                        data_rcvd++;
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                        {
-                            _debug->print(F("\t- data"));
-                        }
-                        if (_response_data_start == 0)
-                        {
-                            _response_data_start = n_byte;
-                        }
-                    }
-                }
-                break;
-
-            case 2: // the third byte is the source address or the data or checksum
-
-                if (_use_target_source_address == true)
+                else // source address
                 {
                     if (incoming == ECU_addr)
                     {
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                         {
                             _debug->print(F("\t- comes from the ECU"));
                         }
                     }
                     else
                     {
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                         {
                             // check who sent it
                             _debug->print(F("\t- doesn't come from the ECU"));
@@ -1524,91 +3904,84 @@ void KWP2000::listenResponse(const uint8_t use_delay)
                         setError(EE_FROM);
                     }
                 }
-                else // data or checksum
+            }
+            else if (data_rcvd < data_to_rcv) // data
+            {
+                data_rcvd++;
+                if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                 {
-                    if (data_to_rcv == data_rcvd) // it is the checksum
-                    {
-                        response_completed = true;
-                        _response_len = n_byte;
-                        endResponse(incoming);
-                    }
-                    else // there is still data outside
-                    {
-                        data_rcvd++;
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                        {
-                            _debug->print(F("\t- data"));
-                        }
-                        if (_response_data_start == 0)
-                        {
-                            _response_data_start = n_byte;
-                        }
-                    }
+                    _debug->print(F("\t- data"));
                 }
-                break;
-
-            case 3: // the fourth byte is the lenght byte or the data or checksum
-
-                if (data_to_rcv == 0) // it is the lenght byte
+                if (data_rcvd == 1)
                 {
-                    data_to_rcv = incoming;
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                    {
-                        _debug->print(F("\t- data bytes coming in HEX"));
-                    }
+                    data_start = n_byte;
                 }
-                else // data or checksum
+            }
+            else // checksum
+            {
+                endResponse(frame_start, n_byte, incoming);
+                if (data_rcvd >= 3 && _response[data_start] == request_rejected && _response[data_start + 2] == 0x78)
                 {
-                    if (data_to_rcv == data_rcvd) // it is the checksum
+                    // response pending: the ECU needs more time, it is overwritten by the real response
+                    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
                     {
-                        response_completed = true;
-                        _response_len = n_byte;
-                        endResponse(incoming);
-                    }
-                    else // data
-                    {
-                        data_rcvd++;
-                        if (_debug_level == DEBUG_LEVEL_VERBOSE)
-                        {
-                            _debug->print(F("\t- data"));
-                        }
-                        if (_response_data_start == 0)
-                        {
-                            _response_data_start = n_byte;
-                        }
+                        _debug->println(F("Response pending"));
                     }
+                    timeout = ISO_T_P3_MAX;
+                    n_byte = frame_start;
                 }
-                break;
-
-            default: // data or checksum
-
-                if (data_to_rcv == data_rcvd) // it is the checksum
-                {
-                    response_completed = true;
-                    _response_len = n_byte;
-                    endResponse(incoming);
-                }
-                else // data
+                else
                 {
-                    data_rcvd++;
-                    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+                    TRACE(TRACE_P3, 1);
+                    _frames[_frames_count].data_start = data_start;
+                    _frames[_frames_count].len = n_byte;
+                    if (_frames_count == 0)
                     {
-                        _debug->print(F("\t- data"));
+                        _response_data_start = data_start;
+                        _response_len = n_byte;
                     }
-                    if (_response_data_start == 0)
+                    _frames_count++;
+                    n_byte++;
+
+                    // the ECU can send another response within P2 max
+                    timeout = ISO_T_P2_MAX;
+                    if (_flags.all_responses == false && ISO_T_P3_MIN < timeout)
                     {
-                        _response_data_start = n_byte;
+                        timeout = ISO_T_P3_MIN; // we have to wait it anyway
                     }
+                    response_completed = _frames_count == KWP2000_MAX_FRAMES;
                 }
-                break;
-            }         // end of the swith statement
+
+                // the next response starts from its format byte
+                frame_start = n_byte;
+                data_start = n_byte;
+                layout = LAYOUT_FMT;
+                header_len = 1;
+                data_to_rcv = 0;
+                data_rcvd = 0;
+                continue;
+            }
             n_byte++; // read the next byte of the response
         }             // end of the if _kline.available()
     }                 // end of the while timeout
 
+    if (n_byte == 0)
+    {
+        TRACE(TRACE_P2, 0); // timeout
+    }
+
     if (use_delay == true)
     {
-        delay(ISO_T_P3_MIN);
+        // P3 min is counted from the end of the last response
+        const uint32_t since_last = KWP2000_MILLIS() - last_data_received;
+        if (_frames_count == 0)
+        {
+            KWP2000_DELAY(ISO_T_P3_MIN);
+        }
+        else if (since_last < ISO_T_P3_MIN)
+        {
+            KWP2000_DELAY(ISO_T_P3_MIN - since_last);
+        }
     }
 }
 
@@ -1618,11 +3991,11 @@ void KWP2000::listenResponse(const uint8_t use_delay)
  * @param request_sent The request sent to the ECU
  * @return `true` if the response is correct, a `negative number` if is not
  */
-int8_t KWP2000::checkResponse(const uint8_t request_sent[])
+int8_t KWP2000Base::checkResponse(const uint8_t request_sent[])
 {
     if (_response[_response_data_start] == (request_ok(request_sent[0])))
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("\nCorrect response from the ECU\n"));
         }
@@ -1630,7 +4003,7 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
     }
     else if (_response[_response_data_start] == 0)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("\nNo response from the ECU\n"));
         }
@@ -1638,7 +4011,8 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
     }
     else if (_response[_response_data_start] == request_rejected)
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        _last_nrc = _response[_response_data_start + 2];
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("\nRequest rejected with code: "));
         }
@@ -1655,28 +4029,28 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
         switch (_response[_response_data_start + 2])
         {
         case 0x10:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("General\n"));
             }
             return -2;
 
         case 0x11:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Service Not Supported\n"));
             }
             return -3;
 
         case 0x12:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Sub Function Not Supported or Invalid Format\n"));
             }
             return -4;
 
         case 0x21:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Busy, reapeat\n"));
             }
@@ -1685,19 +4059,44 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
             return -5;
 
         case 0x22:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Conditions Not Correct or Request Sequence Error\n"));
             }
             return -6;
+
+        case 0x33:
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(F("Security Access Denied\n"));
+            }
+            _security_level = 0; // the ECU is locked, the next securityAccess() will unlock it again
+            return -10;
+
+        case 0x35:
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(F("Invalid Key\n"));
+            }
+            return -11;
+
+        case 0x36:
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(F("Exceed Number Of Attempts\n"));
+            }
+            return -12;
+
+        case 0x37:
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
+            {
+                _debug->println(F("Required Time Delay Not Expired\n"));
+            }
+            return -13;
             /*
             todo
             23 routineNotComplete 
             31 requestOutOfRange 
-            33 securityAccessDenied 
-            35 invalidKey 
-            36 exceedNumberOfAttempts 
-            37 requiredTimeDelayNotExpired 
             40 downloadNotAccepted 
             41 improperDownloadType 
             42 can 'tDownloadToSpecifiedAddress                
@@ -1714,7 +4113,7 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
             77 blockTransferDataChecksumError
             */
         case 0x78:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Request Correctly Received - Response Pending\n"));
             }
@@ -1740,7 +4139,7 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
             80 - FF manufacturerSpecificCodes
             */
         default:
-            if (_debug_level == DEBUG_LEVEL_VERBOSE)
+            if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
             {
                 _debug->println(F("Unknown error code\n"));
             }
@@ -1749,10 +4148,10 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
     }
     else
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("\nUnexpected response: "));
-            for (uint8_t n = _response_data_start; n < _response_len; n++)
+            for (uint16_t n = _response_data_start; n < _response_len; n++)
             {
                 _debug->println(_response[n], HEX);
             }
@@ -1766,12 +4165,33 @@ int8_t KWP2000::checkResponse(const uint8_t request_sent[])
     return -10;
 }
 
+/**
+ * @brief Print how much time passed since `since` as `x.yy seconds ago`, it uses only integer math and no `String`
+ * so nothing is allocated on the heap even when it is called for hours
+ * 
+ * @param since The `millis()` value of the event
+ */
+void KWP2000Base::printSecondsAgo(const uint32_t since)
+{
+    const uint32_t elapsed = KWP2000_MILLIS() - since;
+    const uint16_t hundredths = (elapsed % 1000) / 10;
+
+    _debug->print(elapsed / 1000);
+    _debug->print('.');
+    if (hundredths < 10)
+    {
+        _debug->print('0');
+    }
+    _debug->print(hundredths);
+    _debug->println(F(" seconds ago"));
+}
+
 /**
  * @brief Set errors from `error_enum`
  * 
  * @param error The error you want to set
  */
-void KWP2000::setError(const uint8_t error)
+void KWP2000Base::setError(const uint8_t error)
 {
     bitSet(_ECU_error, error);
 }
@@ -1781,7 +4201,7 @@ void KWP2000::setError(const uint8_t error)
  * 
  * @param error The error you want to clear
  */
-void KWP2000::clearError(const uint8_t error)
+void KWP2000Base::clearError(const uint8_t error)
 {
     bitClear(_ECU_error, error);
 }
@@ -1789,7 +4209,7 @@ void KWP2000::clearError(const uint8_t error)
 /**
  * @brief Configure the K-Line behaviour from the keybytes received by the ECU 
  */
-void KWP2000::configureKline()
+void KWP2000Base::configureKline()
 {
     // get the key bytes
     if (_response[_response_data_start + 2] != 0x8F)
@@ -1798,6 +4218,7 @@ void KWP2000::configureKline()
     }
 
     uint16_t key_bytes = _response[_response_data_start + 2] << 8 | _response[_response_data_start + 1];
+    _key_bytes = key_bytes;
 
     // lenght byte
     uint8_t AL0 = bitRead(key_bytes, 0);
@@ -1805,17 +4226,17 @@ void KWP2000::configureKline()
     if (AL1 == 1 && AL0 == 1)
     {
         // both are possible, so choose the faster one
-        _use_lenght_byte = false;
+        _link.length_byte = false;
     }
     else if (AL1 == 1 && AL0 == 0)
     {
         // lenght byte must be present
-        _use_lenght_byte = true;
+        _link.length_byte = true;
     }
     else if (AL1 == 0 && AL0 == 1)
     {
         // lenght byte not needed
-        _use_lenght_byte = false;
+        _link.length_byte = false;
     }
 
     // target and source
@@ -1824,17 +4245,17 @@ void KWP2000::configureKline()
     if (HB1 == 1 && HB0 == 1)
     {
         // both are possible, so choose the faster one
-        _use_target_source_address = false;
+        _link.addresses = false;
     }
     else if (HB1 == 1 && HB0 == 0)
     {
         // target and source address bytes must be present
-        _use_target_source_address = true;
+        _link.addresses = true;
     }
     else if (HB1 == 0 && HB0 == 1)
     {
         // target and source address bytes not needed
-        _use_target_source_address = false;
+        _link.addresses = false;
     }
 
     // timing
@@ -1846,11 +4267,11 @@ void KWP2000::configureKline()
     }
     else if (TP1 == 1 && TP0 == 0)
     {
-        _timing_parameter = true; // normal
+        _link.timing = true; // normal
     }
     else if (TP1 == 0 && TP0 == 1)
     {
-        _timing_parameter = false; // extended
+        _link.timing = false; // extended
         // this allow faster comunication but I don't plan to implement it soon
         setError(EE_US);
     }
@@ -1858,9 +4279,9 @@ void KWP2000::configureKline()
     if (AL0 == 0 && AL1 == 0 && HB0 == 0 && HB1 == 0 && TP0 == 1 && TP1 == 0)
     {
         // it will use the same configuration as in the first response
-        _use_lenght_byte = maybe;
-        _use_target_source_address = maybe;
-        _timing_parameter = maybe;
+        _link.length_byte = maybe;
+        _link.addresses = maybe;
+        _link.timing = maybe;
     }
 
     // must be 1
@@ -1884,7 +4305,9 @@ void KWP2000::configureKline()
         setError(EE_CONFIG);
     }
 
-    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+    updateLayout();
+
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
     {
         _debug->println("\nK line config:");
         _debug->print("Key bytes:\t\t\t0x");
@@ -1894,11 +4317,14 @@ void KWP2000::configureKline()
         _debug->print("Errors:\t\t\t\t");
         _debug->println(bitRead(_ECU_error, EE_CONFIG) == 1 ? "Yes" : "No");
         _debug->print("Lenght byte:\t\t");
-        _debug->println(_use_lenght_byte == 1 ? "Yes" : "No");
+        _debug->println(_link.length_byte == 1 ? "Yes" : "No");
         _debug->print("Addresses bytes:\t");
-        _debug->println(_use_target_source_address == 1 ? "Yes" : "No");
+        _debug->println(_link.addresses == 1 ? "Yes" : "No");
         _debug->print("Timing parameter:\t");
-        _debug->println(_timing_parameter == 1 ? "Normal\n" : "Extended\n");
+        _debug->println(_link.timing == 1 ? "Normal" : "Extended");
+        _debug->print("Header lenght:\t\t");
+        _debug->println(_link.header_len);
+        _debug->println();
     }
 }
 
@@ -1909,10 +4335,10 @@ void KWP2000::configureKline()
  * @param data_len The lenght of the response
  * @return The correct checksum
  */
-uint8_t KWP2000::calc_checksum(const uint8_t data[], const uint8_t data_len)
+uint8_t KWP2000Base::calc_checksum(const uint8_t data[], const uint16_t data_len)
 {
     uint8_t cs = 0;
-    for (uint8_t i = 0; i < data_len; i++)
+    for (uint16_t i = 0; i < data_len; i++)
     {
         cs += data[i];
     }
@@ -1920,39 +4346,44 @@ uint8_t KWP2000::calc_checksum(const uint8_t data[], const uint8_t data_len)
 }
 
 /**
- * @brief This is called when the last byte is received from the ECU
+ * @brief This is called when the last byte of a response is received from the ECU
  * 
+ * @param start Where the response starts in `_response`
+ * @param len Where its checksum is in `_response`
  * @param received_checksum The last byte received which is the checksum
  */
-void KWP2000::endResponse(const uint8_t received_checksum)
+void KWP2000Base::endResponse(const uint16_t start, const uint16_t len, const uint8_t received_checksum)
 {
     uint8_t correct_checksum;
 
-    if (_debug_level == DEBUG_LEVEL_VERBOSE)
+    if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
     {
         _debug->println(F("\t- checksum"));
         _debug->println(F("\nEnd of response"));
         _debug->print(F("Bytes received: "));
-        _debug->println(_response_len);
+        _debug->println(len - start);
     }
 
-    correct_checksum = calc_checksum(_response, _response_len);
+    correct_checksum = calc_checksum(&_response[start], len - start);
     if (correct_checksum == received_checksum)
     {
         // the checksum is correct and everything went well!
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->println(F("Correct checksum"));
         }
-        _last_correct_response = millis();
+        _last_correct_response = KWP2000_MILLIS();
+        _silent_keep_alives = 0;
+        TRACE(TRACE_CHECKSUM, true);
     }
     else // the checksum is not correct
     {
-        if (_debug_level == DEBUG_LEVEL_VERBOSE)
+        if (DEBUG_AT(DEBUG_LEVEL_VERBOSE))
         {
             _debug->print(F("Wrong checksum, expected: "));
             _debug->println(correct_checksum, HEX);
         }
+        TRACE(TRACE_CHECKSUM, false);
         setError(EE_CS);
     }
 }
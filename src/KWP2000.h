@@ -40,6 +40,35 @@ run doxygen + moxygen
 #ifndef KWP2000_h
 #define KWP2000_h
 
+/*
+Compile time policies
+The Arduino IDE compiles the library on its own, so a `#define` in your sketch won't change them:
+set them in the build flags (e.g. `build_flags = -D KWP2000_DEBUG_MAX=0` in PlatformIO) or here.
+The motorbike is chosen in the same way, see PIDs.h
+*/
+#ifndef KWP2000_SERIAL
+#define KWP2000_SERIAL HardwareSerial ///< transport: any class with begin(baud, config), end(), available(), read(), write(), flush()
+#endif
+#ifndef KWP2000_MILLIS
+#define KWP2000_MILLIS() millis() ///< clock: milliseconds since boot
+#endif
+#ifndef KWP2000_DELAY
+#define KWP2000_DELAY(ms) delay(ms) ///< clock: blocking wait in milliseconds
+#endif
+#ifndef KWP2000_MICROS
+#define KWP2000_MICROS() micros() ///< clock: microseconds since boot, used only by the trace
+#endif
+#ifndef KWP2000_TRACE
+#define KWP2000_TRACE 1 ///< tracing: `0` removes the calls of the trace callback, see `setTraceCallback()`
+#endif
+#ifndef KWP2000_DEBUG_MAX
+#define KWP2000_DEBUG_MAX DEBUG_LEVEL_VERBOSE ///< logging: messages above this level are not compiled, `DEBUG_LEVEL_NONE` removes them all
+#endif
+
+// These values are defined by the ISO protocol
+#define ISO_MAX_DATA 260 ///< maximum lenght of a response from the ecu: 255 data + 4 header + 1 checksum
+#define ISO_MIN_DATA 12  ///< lenght of the longest frame used by the library itself: the timing parameters
+
 /**
  * @brief Collection of possible debug levels
  */
@@ -50,6 +79,62 @@ enum debug_enum
     DEBUG_LEVEL_VERBOSE
 };
 
+#ifndef KWP2000_MAX_DTC
+#define KWP2000_MAX_DTC 8 ///< how many DTC are kept by `readTroubleCodes()`
+#endif
+
+#ifndef KWP2000_ID_LEN
+#define KWP2000_ID_LEN 12 ///< lenght of the text fields of `ecu_id_t`, longer values are truncated
+#endif
+
+#ifndef KWP2000_MAX_KEY
+#define KWP2000_MAX_KEY 8 ///< the longest seed and key handled by `securityAccess()`
+#endif
+
+#ifndef KWP2000_SECURITY_DELAY
+#define KWP2000_SECURITY_DELAY 10000 ///< ms to wait after a required time delay or too many wrong keys
+#endif
+
+#ifndef KWP2000_MAX_GEAR
+#define KWP2000_MAX_GEAR 6 ///< the highest gear, see `setGearRatios()`
+#endif
+
+#ifndef KWP2000_GEAR_MIN_SPEED
+#define KWP2000_GEAR_MIN_SPEED 10 ///< km/h, under this speed the gear is not inferred from the RPM
+#endif
+
+#ifndef KWP2000_THROTTLE_SPAN
+#define KWP2000_THROTTLE_SPAN 32 ///< raw values between idle and WOT before a learned throttle calibration is used
+#endif
+
+#ifndef KWP2000_MAX_TRIGGERS
+#define KWP2000_MAX_TRIGGERS 4 ///< how many triggers can open a capture window, see `addTrigger()`
+#endif
+
+#ifndef KWP2000_MAX_QUEUE
+#define KWP2000_MAX_QUEUE 4 ///< how many requests can wait in the queue of `update()`, see `queueRequest()`
+#endif
+
+#ifndef KWP2000_QUEUE_AGING
+#define KWP2000_QUEUE_AGING 500 ///< milliseconds in the queue of `update()` before a request moves to the next priority
+#endif
+
+#ifndef KWP2000_MAX_POLICIES
+#define KWP2000_MAX_POLICIES 4 ///< how many services can have a retry policy of their own, see `setRetryPolicy()`
+#endif
+
+#ifndef KWP2000_MAX_FRAMES
+#define KWP2000_MAX_FRAMES 4 ///< how many responses to the same request are kept, see `getResponseCount()`
+#endif
+
+#ifndef KWP2000_SILENT_KEEP_ALIVES
+#define KWP2000_SILENT_KEEP_ALIVES 4 ///< tester present without answer in a row, then one with answer checks that the ECU is still there
+#endif
+
+#ifndef KWP2000_MAX_COLLISIONS
+#define KWP2000_MAX_COLLISIONS 3 ///< how many times a request is sent again after a collision, without counting an attempt
+#endif
+
 /**
  * @brief Used by `readTroubleCodes()`
  */
@@ -60,42 +145,352 @@ enum trouble_codes
     READ_ALL
 };
 
-class KWP2000
+/**
+ * @brief A Diagnostic Trouble Code (DTC) read from the ECU
+ */
+struct dtc_t
+{
+    uint16_t code;  ///< the two bytes of the DTC
+    uint8_t status; ///< the status of the DTC, `0` with `READ_TOTAL` because the ECU doesn't send it
+};
+
+/**
+ * @brief The identification of the ECU, see `readECUIdentification()`. Empty fields are not supported by the ECU
+ */
+struct ecu_id_t
+{
+    char vin[18];                             ///< Vehicle Identification Number (0x90)
+    char part_number[KWP2000_ID_LEN + 1];     ///< vehicle manufacturer spare part number (0x87)
+    char hardware_number[KWP2000_ID_LEN + 1]; ///< vehicle manufacturer ECU hardware number (0x91)
+    char software_number[KWP2000_ID_LEN + 1]; ///< system supplier ECU software number (0x94)
+    char system_name[KWP2000_ID_LEN + 1];     ///< system name or engine type (0x97)
+    uint32_t fingerprint;                     ///< hash of all the fields, use it to recognize the ECU
+};
+
+/**
+ * @brief Used by `enableStorage()` to read from a persistent memory (e.g. the EEPROM)
+ */
+typedef void (*storage_read_t)(const uint16_t address, uint8_t data[], const uint16_t len);
+
+/**
+ * @brief Used by `enableStorage()` to write to a persistent memory (e.g. the EEPROM)
+ */
+typedef void (*storage_write_t)(const uint16_t address, const uint8_t data[], const uint16_t len);
+
+/**
+ * @brief Calculate the key for `securityAccess()`, it depends on the manufacturer of the ECU
+ * 
+ * @param level The security level requested, the odd value used to ask the seed
+ * @param seed The seed sent by the ECU
+ * @param seed_len The lenght of the seed
+ * @param key Where the key must be written
+ * @param key_size The maximum lenght of the key
+ * @return The lenght of the key, `0` if it can't be calculated
+ */
+typedef uint8_t (*security_key_t)(const uint8_t level, const uint8_t seed[], const uint8_t seed_len, uint8_t key[], const uint8_t key_size);
+
+/**
+ * @brief The sensors in a `sensors_snapshot`
+ */
+enum sensor_channel
+{
+    CH_GPS,   ///< Gear Position Sensor
+    CH_RPM,   ///< Right Per Minutes
+    CH_SPEED, ///< speed of the bike
+    CH_TPS,   ///< Throttle Position Sensor
+    CH_IAP,   ///< Intake Air Pressure
+    CH_IAT,   ///< Intake Air Temperature
+    CH_ECT,   ///< Engine Coolant Temperature
+    CH_STPS,  ///< Secondary Throttle Position Sensor
+    CH_TOTAL  ///< this is just to know how many channels are in this enum
+};
+
+/**
+ * @brief The units of the temperatures, see `setTemperatureUnit()`
+ */
+enum temperature_unit
+{
+    UNIT_CELSIUS,
+    UNIT_FAHRENHEIT
+};
+
+/**
+ * @brief The settings of the serial port for the K-Line, see `enableAutoBaud()`
+ */
+struct line_config_t
+{
+    uint32_t baudrate; ///< e.g. `10400`
+    uint32_t config;   ///< the config given to `begin()`, e.g. `SERIAL_8O1`
+};
+
+/**
+ * @brief The linear calibration of a channel: two raw values from the ECU and their values, see `setCalibration()`
+ */
+struct calibration_t
+{
+    uint8_t raw_low;    ///< a raw value from the response
+    uint8_t raw_high;   ///< another raw value, higher than `raw_low`
+    int16_t value_low;  ///< the value of `raw_low`, in the units of the channel (Celsius for the temperatures)
+    int16_t value_high; ///< the value of `raw_high`
+};
+
+/**
+ * @brief All the sensors values decoded from one response, see `getSensors()` and `setSensorsCallback()`
+ */
+struct sensors_snapshot
+{
+    uint32_t time;            ///< when the response has been decoded, in milliseconds
+    uint16_t value[CH_TOTAL]; ///< the values, in the same units of the get* functions
+};
+
+/**
+ * @brief Called each time the sensors are decoded, see `setSensorsCallback()`
+ */
+typedef void (*sensors_callback_t)(const sensors_snapshot &snapshot);
+
+/**
+ * @brief The priority classes of `queueRequest()`, the sensors requests of `update()` are `PRIORITY_NORMAL`
+ */
+enum request_priority
+{
+    PRIORITY_HIGH,
+    PRIORITY_NORMAL,
+    PRIORITY_LOW
+};
+
+/**
+ * @brief Called by `update()` after a queued request, the response is in `getResponseData()`, see `queueRequest()`
+ */
+typedef void (*request_callback_t)(const uint8_t request[], const int8_t result);
+
+/**
+ * @brief How `update()` kept the deadlines, see `getSchedulerStats()`
+ */
+struct scheduler_stats
+{
+    uint32_t completed;      ///< sensors and queued requests
+    uint32_t missed;         ///< completed after their deadline
+    uint32_t worst_lateness; ///< ms after the deadline of the latest one
+    uint16_t expired;        ///< connections lost because no request was sent within P3 max
+};
+
+/**
+ * @brief How `handleRequest()` tries again a request of a service, see `setRetryPolicy()`. 
+ *          No answer and wrong answers are always tried again, a negative response only if it is 0x21 (busy, repeat request) or in `retry_nrc`
+ */
+struct retry_policy_t
+{
+    uint8_t attempts;     ///< at least 1, `handleRequest()` without a policy makes 3
+    uint16_t backoff;     ///< ms before the second attempt, doubled before each other one, plus a random jitter up to its half
+    uint8_t retry_nrc[2]; ///< other negative response codes worth another attempt, e.g. 0x22 (conditions not correct), `0` if unused
+    uint8_t breaker;      ///< failed requests in a row that stop the service, `0` never
+    uint16_t probe;       ///< ms before a stopped service is tried again with a single attempt
+};
+
+/**
+ * @brief The conditions of `addTrigger()`
+ */
+enum trigger_type
+{
+    TRIGGER_ABOVE,  ///< the channel is over the threshold
+    TRIGGER_BELOW,  ///< the channel is under the threshold
+    TRIGGER_DELTA,  ///< the channel changed more than the threshold since the previous snapshot
+    TRIGGER_NEW_DTC ///< a new DTC has been read, the channel and the threshold are not used
+};
+
+/**
+ * @brief A condition which opens a capture window, see `addTrigger()`
+ */
+struct trigger_t
+{
+    uint8_t type;       ///< one of the `trigger_type`
+    uint8_t channel;    ///< one of the `sensor_channel`
+    uint16_t threshold; ///< in the same units of the channel
+};
+
+/**
+ * @brief What a snapshot given to the `capture_callback_t` is
+ */
+enum capture_event
+{
+    CAPTURE_HISTORY, ///< decoded before the trigger, from the history given to `enableCapture()`, oldest first
+    CAPTURE_TRIGGER, ///< the snapshot which opened the window
+    CAPTURE_LIVE,    ///< decoded during the window
+    CAPTURE_END      ///< the first snapshot after the window, it closes it
+};
+
+/**
+ * @brief Called for each snapshot of a capture window, see `enableCapture()`
+ * 
+ * @param snapshot The sensors
+ * @param event One of the `capture_event`
+ * @param trigger The index of the trigger which opened the window, as returned by `addTrigger()`
+ */
+typedef void (*capture_callback_t)(const sensors_snapshot &snapshot, const uint8_t event, const uint8_t trigger);
+
+/**
+ * @brief The result of each identifier of `scanIdentifiers()`
+ */
+enum scan_result
+{
+    SCAN_SUPPORTED,     ///< positive response echoing the identifier
+    SCAN_NOT_SUPPORTED, ///< rejected with service or sub function not supported, or request out of range
+    SCAN_REJECTED,      ///< rejected for other reasons (e.g. security access), it exists
+    SCAN_NO_ANSWER      ///< no response within P2 max, or a late one for another identifier
+};
+
+/**
+ * @brief Called by `scanIdentifiers()` for each identifier
+ * 
+ * @param sid The service scanned
+ * @param id The identifier
+ * @param result One of the `scan_result`
+ * @param data The data of the positive response, after the SID and the identifier
+ * @param len The lenght of `data`, `0` if the identifier is not supported
+ */
+typedef void (*scan_callback_t)(const uint8_t sid, const uint8_t id, const uint8_t result, const uint8_t data[], const uint16_t len);
+
+/**
+ * @brief Who sent a frame captured by the sniffer
+ */
+enum frame_direction
+{
+    FRAME_REQUEST, ///< from the tester to the ECU
+    FRAME_RESPONSE ///< from the ECU to the tester
+};
+
+/**
+ * @brief Called by the sniffer for each valid frame, see `startSniffer()`
+ * 
+ * @param time When the frame has been completed, in milliseconds
+ * @param direction One of the `frame_direction`
+ * @param frame The whole frame: header, data and checksum
+ * @param len The lenght of the frame
+ */
+typedef void (*frame_callback_t)(const uint32_t time, const uint8_t direction, const uint8_t frame[], const uint16_t len);
+
+/**
+ * @brief The events given to the trace callback, see `setTraceCallback()`
+ */
+enum trace_event
+{
+    TRACE_TX,       ///< a byte written to the K-Line, the value is the byte
+    TRACE_RX,       ///< a byte read from the K-Line (the echo too), the value is the byte
+    TRACE_K_OUT,    ///< the K out pin driven during the fast init, the value is the level
+    TRACE_INIT,     ///< a step of the fast init, the value is `0` to `3` for T0 to T3
+    TRACE_P2,       ///< `1` at the end of a request, `0` at the first byte of the response or the timeout
+    TRACE_P3,       ///< `1` at the end of a response, `0` at the start of the next request
+    TRACE_CHECKSUM  ///< the checksum of a response, the value is `true` if it is correct
+};
+
+/**
+ * @brief Called for each event on the K-Line, see `setTraceCallback()`
+ * 
+ * @param time When it happened, in microseconds
+ * @param event One of the `trace_event`
+ * @param value Its value
+ */
+typedef void (*trace_callback_t)(const uint32_t time, const uint8_t event, const uint8_t value);
+
+/**
+ * @brief Called by the DTC monitor, see `monitorTroubleCodes()`
+ */
+typedef void (*dtc_callback_t)(const dtc_t dtc, const uint8_t appeared);
+
+/**
+ * @brief Position of the fields inside a frame, header lenght in brackets
+ */
+enum frame_layout
+{
+    LAYOUT_FMT,          ///< format byte with the lenght (1)
+    LAYOUT_FMT_LEN,      ///< format byte and lenght byte (2)
+    LAYOUT_FMT_ADDR,     ///< format byte with the lenght, target and source addresses (3)
+    LAYOUT_FMT_ADDR_LEN, ///< format byte, target and source addresses, lenght byte (4)
+    LAYOUT_TOTAL         ///< this is just to know how many layouts are in this enum
+};
+
+class KWP2000Base
 {
   public:
-    // CONSTRUCTOR
-    KWP2000(HardwareSerial *kline_serial, const uint8_t k_out_pin, const uint32_t kline_baudrate = 10400);
 
     // SETUP
     void enableDebug(HardwareSerial *debug_serial, const uint8_t debug_level = DEBUG_LEVEL_DEFAULT, const uint32_t debug_baudrate = 115200);
     void setDebugLevel(const uint8_t debug_level);
     void disableDebug();
+    void setTraceCallback(trace_callback_t callback);
     void enableDealerMode(const uint8_t dealer_pin);
     void dealerMode(const uint8_t dealer_mode);
+    void setSecurityKey(security_key_t key_function);
+    void enableStorage(storage_read_t read_function, storage_write_t write_function, const uint16_t address = 0);
+    void setCalibration(const uint8_t channel, const uint8_t raw_low, const int16_t value_low, const uint8_t raw_high, const int16_t value_high);
+    void resetCalibration(const uint8_t channel);
+    void learnThrottle(const uint8_t enable = true);
+    void setTemperatureUnit(const uint8_t unit);
+    void enableAutoBaud(const line_config_t candidates[] = nullptr, const uint8_t candidates_len = 0);
+    void disableAutoBaud();
 
     // COMMUNICATION - Basic
     int8_t initKline();
     int8_t stopKline();
     void requestSensorsData();
-    void readTroubleCodes(const uint8_t which = READ_ONLY_ACTIVE);
+    int8_t readTroubleCodes(const uint8_t which = READ_ONLY_ACTIVE);
+    int8_t pollTroubleCodes();
+    void monitorTroubleCodes(const uint16_t interval, const uint8_t max_bus_share = 5, dtc_callback_t callback = nullptr);
     void clearTroubleCodes(const uint8_t code = 0x00);
+    int8_t readECUIdentification(const uint8_t force = false);
+    int8_t securityAccess(const uint8_t level = 0x01);
     void keepAlive(uint16_t time = 0);
+    void setSensorsInterval(const uint16_t interval);
+    void setSensorsCallback(sensors_callback_t callback);
+    void setGearRatios(const uint16_t ratios[], const uint8_t gears);
+    uint8_t getGearRatios(uint16_t ratios[]);
+    void update();
+    int8_t queueRequest(const uint8_t to_send[], const uint8_t send_len, request_callback_t callback = nullptr, 
+                        const uint8_t priority = PRIORITY_NORMAL, const uint16_t deadline = 0);
+    const scheduler_stats &getSchedulerStats();
+    void resetSchedulerStats();
+
+    // CAPTURE
+    void enableCapture(capture_callback_t callback, sensors_snapshot history[] = nullptr, const uint8_t history_len = 0);
+    void setCaptureWindow(const uint16_t pre_trigger, const uint16_t post_trigger, const uint16_t interval = 1);
+    int8_t addTrigger(const uint8_t type, const uint8_t channel = CH_RPM, const uint16_t threshold = 0);
+    void clearTriggers();
+    uint8_t isCapturing();
 
     // COMMUNICATION - Advanced
     int8_t handleRequest(const uint8_t to_send[], const uint8_t send_len, const uint8_t try_once = false);
+    int8_t setRetryPolicy(const uint8_t sid, const retry_policy_t &policy);
+    void clearRetryPolicies();
+    void setBusIdle(const uint16_t idle);
+    void collectResponses(const uint8_t enable = true);
     void accessTimingParameter(const uint8_t read_only = true);
     void resetTimingParameter();
     void changeTimingParameter(uint32_t new_atp[], const uint8_t new_atp_len);
+    int16_t scanIdentifiers(const uint8_t sid, const uint8_t first, const uint8_t last, scan_callback_t callback = nullptr);
+
+    // SNIFFER
+    void startSniffer(frame_callback_t callback = nullptr);
+    void stopSniffer();
+    int8_t sniff();
 
     // PRINT and GET
     void printStatus(uint16_t time = 2000);
     void printSensorsData();
     void printLastResponse();
+    const uint8_t *getResponseData(const uint8_t frame = 0);
+    uint16_t getResponseLength(const uint8_t frame = 0);
+    uint8_t getResponseCount();
+    line_config_t getLineConfig();
     int8_t getStatus();
     int8_t getError();
     void resetError();
+    uint8_t getLastNRC();
+    uint8_t getTroubleCodesCount();
+    dtc_t getTroubleCode(const uint8_t index);
+    const ecu_id_t &getECUIdentification();
+    sensors_snapshot getSensors();
     uint8_t getGPS();
-    uint8_t getRPM();
+    uint16_t getRPM();
     uint8_t getSPEED();
     uint8_t getTPS();
     uint8_t getIAP();
@@ -103,29 +498,74 @@ class KWP2000
     uint8_t getECT();
     uint8_t getSTPS();
 
+  protected:
+    // CONSTRUCTOR
+    KWP2000Base(KWP2000_SERIAL *kline_serial, const uint8_t k_out_pin, const uint32_t kline_baudrate,
+                uint8_t response[], const uint16_t response_size, uint8_t request[], const uint16_t request_size);
+
   private:
     // K-Line
-    HardwareSerial *_kline;
+    KWP2000_SERIAL *_kline;
     uint32_t _kline_baudrate;
+    uint32_t _kline_config;
+
+    // line auto-detection, see enableAutoBaud()
+    const line_config_t *_line_candidates = nullptr;
+    uint8_t _line_candidates_len = 0;
+    uint8_t _line_next = 0;      // 0: the stored line config is the next one, n: the candidate n - 1
+    line_config_t _line_default; // the one of the constructor
     uint8_t _k_out_pin;
     uint8_t _dealer_pin;
-    uint8_t _dealer_mode;
-    uint8_t _init_sequence_started = false;
-    uint8_t _stop_sequence_started = false;
     uint32_t _start_time = 0;
     uint32_t _elapsed_time = 0;
-    uint8_t _response[260]; //todo use max data
-    uint8_t _response_len = 0;
+    uint8_t *const _response;
+    const uint16_t _response_size;
+    uint16_t _response_len = 0;
     uint8_t _response_data_start = 0;
-    uint8_t _request[20];
-    uint8_t _request_len = 0;
-    uint8_t _ECU_status = false;
+    struct
+    {
+        uint16_t data_start;
+        uint16_t len; // as _response_len, the index of the checksum
+    } _frames[KWP2000_MAX_FRAMES]; // all the responses to the last request, the first is also in _response_len
+    uint8_t _frames_count = 0;
+    uint8_t *const _request;
+    const uint16_t _request_size;
+    uint16_t _request_len = 0;
     uint32_t _ECU_error = 0;
+    uint8_t _last_nrc = 0; // negative response code of the last response, 0 if it was positive
+    struct
+    {
+        uint8_t init_sequence_started : 1;
+        uint8_t stop_sequence_started : 1;
+        uint8_t ECU_status : 1;
+        uint8_t debug_enabled : 1;
+        uint8_t dealer_mode : 1;
+        uint8_t dtc_valid : 1;  // _dtc contains the DTC of the last read
+        uint8_t dtc_stale : 1;  // the DTC changed after the last read (e.g. they have been cleared), check them at once
+        uint8_t dtc_by_status : 2; // true, false or maybe: the ECU supports the request of the DTC by status of all groups
+        uint8_t id_valid : 1;   // _ecu_id has been read in this session
+        uint8_t silent_keep_alive : 2; // true, false or maybe: the ECU supports the tester present without answer
+        uint8_t sniffing : 1;          // listen only, see startSniffer()
+        uint8_t capturing : 1;         // a trigger opened a capture window
+        uint8_t gear_sensor : 2;       // true, false or maybe: the ECU sends the gear position
+        uint8_t gear_learning : 1;     // the gear ratios are learned, not given by setGearRatios()
+        uint8_t throttle_learning : 1; // the TPS and STPS calibration comes from their min and max, see learnThrottle()
+        uint8_t fahrenheit : 1;        // the temperatures are in Fahrenheit
+        uint8_t auto_baud : 1;         // the line config is searched by initKline(), see enableAutoBaud()
+        uint8_t all_responses : 1;     // listenResponse() waits P2 max for other responses, see collectResponses()
+    } _flags;
 
-    // k line config
-    uint8_t _use_lenght_byte = true;
-    uint8_t _use_target_source_address = true;
-    uint8_t _timing_parameter = true; // normal
+    uint16_t _key_bytes = 0;
+
+    // k line config, calculated by configureKline()
+    struct
+    {
+        uint8_t length_byte : 2; // true, false or maybe
+        uint8_t addresses : 2;   // true, false or maybe
+        uint8_t timing : 2;      // true (normal), false (extended) or maybe
+        uint8_t layout : 2;      // frame_layout of our requests
+        uint8_t header_len : 3;  // header lenght of our requests
+    } _link;
     uint16_t ISO_T_IDLE = 0;
     uint8_t ISO_T_P2_MIN = 25;
     uint32_t ISO_T_P2_MAX = 50;
@@ -133,33 +573,187 @@ class KWP2000
     uint32_t ISO_T_P3_MAX = 2000;
     uint32_t ISO_T_P3_mdf = 2000;
     uint16_t ISO_T_P4_MIN = 10; // average between min and max value
-    uint16_t _keep_iso_alive = 1000;
+    uint16_t _bus_idle = 20;    // ms without any byte before we transmit, as the max inter byte time
 
     // debug
-    HardwareSerial *_debug;
-    uint8_t _debug_enabled = false;
+    HardwareSerial *_debug = nullptr;
     uint32_t _debug_baudrate;
     uint8_t _debug_level = DEBUG_LEVEL_DEFAULT;
+    trace_callback_t _trace_callback = nullptr;
     uint32_t _last_status_print = 0;
     uint32_t _last_data_print = 0;
     uint32_t _last_sensors_calculated = 0;
     uint32_t _last_correct_response = 0;
+    uint32_t _last_request_sent = 0;
+    uint32_t _last_byte_received = 0; // any byte on the bus, even our echo
+    uint8_t _silent_keep_alives = 0; // tester present without answer sent since the last response
+    uint32_t _last_keep_alive_call = 0;
+    uint32_t _loop_gap = 0;               // max time between two calls of keepAlive(), slowly decreasing
     uint32_t _connection_time = 0;
 
     // sensors
-    uint8_t _GPS, _RPM, _SPEED, _TPS, _IAP, _ECT, _STPS, _IAT;
+    uint8_t _GPS, _SPEED, _TPS, _IAP, _ECT, _STPS, _IAT;
+    uint16_t _RPM;
+    sensors_callback_t _sensors_callback = nullptr;
     uint8_t _GEAR1, _GEAR2, _GEAR3;
 
+    // calibration of the channels from CH_SPEED, folded in value = (raw * scale + offset) / 256
+    static const uint8_t calibrated_channels = CH_TOTAL - CH_SPEED;
+    calibration_t _calibration[calibrated_channels];
+    int32_t _calibration_scale[calibrated_channels];
+    int32_t _calibration_offset[calibrated_channels];
+
+    // gear derivation
+    uint16_t _gear_ratio[KWP2000_MAX_GEAR] = {}; // RPM at 100 km/h of each gear, from the first, 0 if unknown
+    uint8_t _gear_ratios = 0;                    // number of ratios in _gear_ratio
+    uint16_t _last_gear_ratio = 0;               // of the previous snapshot, 0 if the bike wasn't moving
+    uint8_t _gear_pending = 0;                   // the gear which is replacing _GPS
+    uint8_t _gear_pending_count = 0;
+
+    // trouble codes
+    dtc_t _dtc[KWP2000_MAX_DTC];
+    uint8_t _dtc_total = 0;  // number of DTC reported by the ECU
+    uint8_t _dtc_stored = 0; // number of DTC in _dtc
+    dtc_callback_t _dtc_callback = nullptr;
+    uint16_t _dtc_interval = 0;
+    uint8_t _dtc_max_share = 5;    // percentage of the time
+    uint16_t _dtc_poll_time = 0;   // duration of the last check
+    uint32_t _last_dtc_poll = 0;
+    uint32_t _dtc_bus_time = 0;    // time spent checking since _dtc_window_start
+    uint32_t _dtc_window_start = 0;
+
+    // identification and storage
+    ecu_id_t _ecu_id = {};
+    storage_read_t _storage_read = nullptr;
+    storage_write_t _storage_write = nullptr;
+    uint16_t _storage_address = 0;
+
+    // security access
+    security_key_t _security_key = nullptr;
+    uint8_t _security_level = 0;     // unlocked level, 0 if locked
+    uint32_t _security_delay_end = 0; // no requests for the seed before this time, 0 if there isn't a delay
+
+    // sniffer
+    frame_callback_t _frame_callback = nullptr;
+    uint16_t _sniff_len = 0;      // bytes of the current frame
+    uint16_t _sniff_expected = 0; // lenght of the current frame, 0 until the header is complete
+    uint32_t _sniff_last_byte = 0;
+
+    // scheduler
+    uint16_t _sensors_interval = 0;
+    uint32_t _last_sensors_request = 0;
+    struct
+    {
+        const uint8_t *request; // given by the user, it must exist until the callback
+        uint8_t len;
+        uint8_t priority;
+        uint16_t deadline; // ms after queued, 0 if it has no deadline
+        uint32_t queued;
+        request_callback_t callback;
+    } _queue[KWP2000_MAX_QUEUE];
+    uint8_t _queue_len = 0;
+    scheduler_stats _scheduler_stats = {};
+
+    // retry policies and circuit breakers of the services
+    struct
+    {
+        uint8_t sid;
+        retry_policy_t policy;
+        uint8_t failed; // requests in a row, the breaker is open from policy.breaker
+        uint32_t since; // last failure, the next probe is policy.probe ms later
+    } _policies[KWP2000_MAX_POLICIES];
+    uint8_t _policies_count = 0;
+
+    // capture
+    trigger_t _triggers[KWP2000_MAX_TRIGGERS];
+    uint8_t _triggers_count = 0;
+    capture_callback_t _capture_callback = nullptr;
+    sensors_snapshot *_history = nullptr; // ring of the snapshots before the trigger, given by the user
+    uint8_t _history_len = 0;
+    uint8_t _history_count = 0;
+    uint8_t _history_next = 0;
+    uint16_t _capture_pre = 5000;     // ms of history given when the window opens
+    uint16_t _capture_post = 5000;    // ms of the window after the last trigger
+    uint16_t _capture_interval = 1;   // sensors interval during the window
+    uint32_t _capture_end = 0;
+    uint8_t _capture_trigger = 0;
+
     // functions
-    void sendRequest(const uint8_t to_send[], const uint8_t send_len, const uint8_t wait_to_send_all = true, const uint8_t use_delay = true);
-    void listenResponse(const uint8_t use_delay = true);
+    int8_t sendRequest(const uint8_t to_send[], const uint8_t send_len, const uint8_t wait_to_send_all = true, const uint8_t use_delay = true);
+    int8_t waitBusIdle();
+    void listenResponse(const uint8_t use_delay = true, uint32_t timeout = 0, const uint8_t more = false);
     int8_t checkResponse(const uint8_t response_sent[]);
     void setError(const uint8_t error);
     void clearError(const uint8_t error);
     void configureKline();
-    uint8_t calc_checksum(const uint8_t data[], const uint8_t data_len);
-    void endResponse(const uint8_t received_checksum);
+    uint8_t requestHeaderLength(const uint8_t pid_len);
+    void updateLayout();
+    uint8_t responseLayout(const uint8_t format);
+    uint8_t calc_checksum(const uint8_t data[], const uint16_t data_len);
+    void endResponse(const uint16_t start, const uint16_t len, const uint8_t received_checksum);
+    void printSecondsAgo(const uint32_t since);
+    void timingParameter(const uint8_t atp[], const uint8_t read_only);
+    void decodeSensors();
+    void scheduled(const uint32_t deadline);
+    uint8_t calibrated(const uint8_t channel, const uint8_t raw);
+    void foldCalibration(const uint8_t channel);
+    void learnThrottleRaw(const uint8_t channel, const uint8_t raw);
+    void loadCalibration();
+    void saveCalibration();
+    void deriveGear(const uint8_t gear_byte, const uint8_t clutch);
+    void learnGearRatio(const uint16_t ratio);
+    void captureSensors(const sensors_snapshot &previous);
+    void fireTrigger(const uint8_t trigger, const sensors_snapshot &snapshot);
+    void snifferFrame();
+    int8_t securityRejected();
+    int8_t readIdentificationOption(const uint8_t option);
+    uint8_t selectLineConfig();
+    uint8_t loadRecord(const uint16_t offset, uint8_t data[], const uint16_t len);
+    void saveRecord(const uint16_t offset, const uint8_t data[], const uint16_t len);
+    uint8_t parseTroubleCodes();
+    void listenTroubleCodes();
+    void printTroubleCodes();
+    uint8_t findTroubleCode(const dtc_t list[], const uint8_t list_len, const uint16_t code);
+    uint8_t troubleCodesDue(const uint32_t now);
     void connectionExpired();
 };
 
+/**
+ * @brief The KWP2000 class with the size of its buffers chosen at compile time, 
+ *          use it to save RAM when your motorbike sends short responses
+ * 
+ * @tparam RESPONSE_SIZE The lenght of the longest response you expect from the ECU, header and checksum included
+ * @tparam REQUEST_SIZE The lenght of the longest request you will send, header and checksum included
+ */
+template <uint16_t RESPONSE_SIZE, uint16_t REQUEST_SIZE = 20>
+class KWP2000Sized : public KWP2000Base
+{
+    static_assert(RESPONSE_SIZE >= ISO_MIN_DATA, "RESPONSE_SIZE is too small for the timing parameters response");
+    static_assert(RESPONSE_SIZE <= ISO_MAX_DATA, "RESPONSE_SIZE is bigger than the longest ISO 14230 frame");
+    static_assert(REQUEST_SIZE >= ISO_MIN_DATA, "REQUEST_SIZE is too small for the timing parameters request");
+    static_assert(REQUEST_SIZE <= ISO_MAX_DATA, "REQUEST_SIZE is bigger than the longest ISO 14230 frame");
+
+  public:
+    /**
+     * @brief Constructor for the KWP2000 class
+     * 
+     * @param kline_serial The Serial port you will use to communicate with the ECU
+     * @param k_out_pin The TX pin of this serial
+     * @param kline_baudrate Optional, defaut to `10400`. The baudrate for the kline
+     */
+    KWP2000Sized(KWP2000_SERIAL *kline_serial, const uint8_t k_out_pin, const uint32_t kline_baudrate = 10400)
+        : KWP2000Base(kline_serial, k_out_pin, kline_baudrate, _response_buffer, RESPONSE_SIZE, _request_buffer, REQUEST_SIZE)
+    {
+    }
+
+  private:
+    uint8_t _response_buffer[RESPONSE_SIZE];
+    uint8_t _request_buffer[REQUEST_SIZE];
+};
+
+/**
+ * @brief The KWP2000 class with buffers big enough for any ISO 14230 response
+ */
+typedef KWP2000Sized<ISO_MAX_DATA> KWP2000;
+
 #endif // KWP2000_h
@@ -53,10 +53,22 @@ const uint8_t tester_present_without_answer[] = {0x3E, 0x02}; // the ECU won't a
 const uint8_t trouble_codes_all[] = {0x13};
 const uint8_t trouble_codes_only_active[] = {0x17};
 const uint8_t trouble_codes_with_status[] = {0x18};
+const uint8_t trouble_codes_by_status[] = {0x18, 0x00, 0xFF, 0x00}; // the number and the list of the stored DTC of all groups, not every ECU supports it
 
 const uint8_t clear_trouble_codes[] = {0x14};
 
-#define request_ok(x) x | 0x40
+// read ECU identification and its options
+const uint8_t ecu_identification[] = {0x1A};
+const uint8_t id_part_number = 0x87;
+const uint8_t id_vin = 0x90;
+const uint8_t id_hardware_number = 0x91;
+const uint8_t id_software_number = 0x94;
+const uint8_t id_system_name = 0x97;
+
+// security access, followed by the level: odd to request the seed, even to send the key
+const uint8_t security_access[] = {0x27};
+
+#define request_ok(x) ((x) | 0x40)
 const uint8_t request_rejected = 0x7F;
 
 #if defined(SUZUKI)
@@ -0,0 +1,169 @@
+/*
+SensorsAggregator.cpp
+
+Copyright (c) 2019 Aster94
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, 
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or 
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING 
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "SensorsAggregator.h"
+
+/**
+ * @brief The default buckets of each channel: from `0`, the last one is open
+ */
+const uint16_t default_bucket_width[CH_TOTAL] = {
+    1,    // GPS: a bucket for each gear
+    1500, // RPM
+    40,   // SPEED
+    16,   // TPS
+    20,   // IAP
+    20,   // IAT
+    20,   // ECT
+    13,   // STPS
+};
+
+/**
+ * @brief Summarize the sensors snapshots over fixed windows: min, max, mean, variance and a histogram for each channel, 
+ *          without keeping the snapshots. Give it the snapshots from the callback of `setSensorsCallback()`
+ * 
+ * @param window The lenght of a window in milliseconds
+ * @param callback Optional. Called with the summary at the end of each window
+ */
+SensorsAggregator::SensorsAggregator(const uint32_t window, summary_callback_t callback)
+{
+    _window = window;
+    _callback = callback;
+    for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+    {
+        _bucket_low[ch] = 0;
+        _bucket_width[ch] = default_bucket_width[ch];
+        _mean[ch] = 0;
+        _m2[ch] = 0;
+    }
+}
+
+/**
+ * @brief Change the lenght of the windows, from the next one
+ * 
+ * @param window The lenght of a window in milliseconds
+ */
+void SensorsAggregator::setWindow(const uint32_t window)
+{
+    _window = window;
+}
+
+/**
+ * @brief Choose the buckets of the histogram of a channel, from the next window. 
+ *          The first bucket gets also the values under `low`, the last one the values over the range
+ * 
+ * @param channel One of the `sensor_channel`
+ * @param low The lowest value of the first bucket
+ * @param width The range of each bucket, in the same units of the channel
+ */
+void SensorsAggregator::setBuckets(const uint8_t channel, const uint16_t low, const uint16_t width)
+{
+    if (channel >= CH_TOTAL || width == 0)
+    {
+        return;
+    }
+    _bucket_low[channel] = low;
+    _bucket_width[channel] = width;
+}
+
+/**
+ * @brief Add a snapshot to the window, if it is later than the end of the window the summary is sent first
+ * 
+ * @param snapshot The sensors, e.g. from the callback of `setSensorsCallback()`
+ */
+void SensorsAggregator::add(const sensors_snapshot &snapshot)
+{
+    if (_running.count != 0 && snapshot.time - _running.start >= _window)
+    {
+        flush();
+    }
+
+    if (_running.count == 0)
+    {
+        _running.start = snapshot.time;
+    }
+    _running.end = snapshot.time;
+    _running.count++;
+
+    for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+    {
+        channel_summary &summary = _running.channel[ch];
+        const uint16_t value = snapshot.value[ch];
+        if (_running.count == 1 || value < summary.min)
+        {
+            summary.min = value;
+        }
+        if (_running.count == 1 || value > summary.max)
+        {
+            summary.max = value;
+        }
+
+        const float delta = value - _mean[ch];
+        _mean[ch] += delta / _running.count;
+        _m2[ch] += delta * (value - _mean[ch]);
+
+        uint16_t bucket = value > _bucket_low[ch] ? (value - _bucket_low[ch]) / _bucket_width[ch] : 0;
+        if (bucket >= KWP2000_BUCKETS)
+        {
+            bucket = KWP2000_BUCKETS - 1;
+        }
+        if (summary.histogram[bucket] < 0xFFFF)
+        {
+            summary.histogram[bucket]++;
+        }
+    }
+}
+
+/**
+ * @brief End the window now: the summary is sent to the callback and kept for `getSummary()`, 
+ *          call it when the snapshots stop (e.g. the connection is lost). An empty window is not sent
+ */
+void SensorsAggregator::flush()
+{
+    if (_running.count == 0)
+    {
+        return;
+    }
+
+    for (uint8_t ch = 0; ch < CH_TOTAL; ch++)
+    {
+        _running.channel[ch].mean = _mean[ch] + 0.5;
+        _running.channel[ch].variance = _m2[ch] / _running.count + 0.5;
+        _mean[ch] = 0;
+        _m2[ch] = 0;
+    }
+    _summary = _running;
+    _running = {};
+
+    if (_callback != nullptr)
+    {
+        _callback(_summary);
+    }
+}
+
+/**
+ * @brief Get the summary of the last window
+ * 
+ * @return The summary, `count` is `0` if no window has ended yet
+ */
+const sensors_summary &SensorsAggregator::getSummary()
+{
+    return _summary;
+}
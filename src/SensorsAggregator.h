@@ -0,0 +1,81 @@
+/*
+SensorsAggregator.h
+
+Copyright (c) 2019 Aster94
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, 
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or 
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING 
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef SensorsAggregator_h
+#define SensorsAggregator_h
+
+#include "Arduino.h"
+#include "KWP2000.h"
+
+#ifndef KWP2000_BUCKETS
+#define KWP2000_BUCKETS 8 ///< buckets of the histogram of each channel
+#endif
+
+/**
+ * @brief The summary of a channel over a window, see `SensorsAggregator`
+ */
+struct channel_summary
+{
+    uint16_t min;                        ///< the lowest value
+    uint16_t max;                        ///< the highest value
+    uint16_t mean;                       ///< the average, rounded
+    uint32_t variance;                   ///< the population variance, rounded
+    uint16_t histogram[KWP2000_BUCKETS]; ///< how many values in each bucket, see `setBuckets()`
+};
+
+/**
+ * @brief The summary of all the channels over a window
+ */
+struct sensors_summary
+{
+    uint32_t start;                    ///< time of the first snapshot, in milliseconds
+    uint32_t end;                      ///< time of the last snapshot, in milliseconds
+    uint32_t count;                    ///< number of snapshots, `0` if the window was empty
+    channel_summary channel[CH_TOTAL]; ///< one for each `sensor_channel`
+};
+
+/**
+ * @brief Called at the end of each window, see `SensorsAggregator`
+ */
+typedef void (*summary_callback_t)(const sensors_summary &summary);
+
+class SensorsAggregator
+{
+  public:
+    SensorsAggregator(const uint32_t window, summary_callback_t callback = nullptr);
+    void setWindow(const uint32_t window);
+    void setBuckets(const uint8_t channel, const uint16_t low, const uint16_t width);
+    void add(const sensors_snapshot &snapshot);
+    void flush();
+    const sensors_summary &getSummary();
+
+  private:
+    uint32_t _window;
+    summary_callback_t _callback;
+    uint16_t _bucket_low[CH_TOTAL];
+    uint16_t _bucket_width[CH_TOTAL];
+    float _mean[CH_TOTAL]; // running mean and sum of the squared differences (Welford)
+    float _m2[CH_TOTAL];
+    sensors_summary _running = {};
+    sensors_summary _summary = {};
+};
+
+#endif // SensorsAggregator_h
@@ -0,0 +1,359 @@
+/*
+VCDWriter.cpp
+
+Copyright (c) 2019 Aster94
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, 
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or 
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING 
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "VCDWriter.h"
+
+#define LINE_TX 0
+#define LINE_RX 1
+#define NO_PARITY 2
+
+/**
+ * @brief Write the trace of the K-Line (see `setTraceCallback()`) as a Value Change Dump, to open it with 
+ *          a waveform viewer like GTKWave. The TX and RX lines are drawn bit by bit from the bytes, 
+ *          with the bytes values, the steps of the fast init, the P2 and P3 windows and the checksum results
+ * 
+ * @param out Where the file is written, e.g. `Serial` or a `File` of the SD library
+ * @param buffer Where the events are kept from `add()` to `write()`
+ * @param buffer_len The number of events of `buffer`, a request and its response need about two for each byte
+ * @param baudrate Optional, default to `10400`. The baudrate of the K-Line, to draw the bits
+ * @param config Optional, default to `SERIAL_8O1`. The config of the K-Line: `SERIAL_8N1`, `SERIAL_8E1` or `SERIAL_8O1`
+ */
+VCDWriter::VCDWriter(Print &out, trace_record buffer[], const uint16_t buffer_len, const uint32_t baudrate, const uint32_t config)
+    : _out(out), _buffer(buffer), _buffer_len(buffer_len)
+{
+    setLineConfig({baudrate, config});
+    for (uint8_t line = 0; line < 2; line++)
+    {
+        _line_level[line] = HIGH;
+    }
+}
+
+/**
+ * @brief Change the line config used to draw the bits, e.g. the one found by `enableAutoBaud()` (see `getLineConfig()`). 
+ *          It is used for the events written from now on
+ * 
+ * @param line The baudrate and the config of the K-Line
+ */
+void VCDWriter::setLineConfig(const line_config_t &line)
+{
+    // the bytes already started keep the old bits, the next ones wait for their end
+    for (uint8_t l = 0; l < 2; l++)
+    {
+        if (_started == true && _line_next[l] < _byte_bits)
+        {
+            advance(bitTime(l, _byte_bits));
+        }
+    }
+
+    _bit_time = 16000000UL / line.baudrate;
+    if (line.config == SERIAL_8N1)
+    {
+        _parity = NO_PARITY;
+        _byte_bits = 10;
+    }
+    else
+    {
+        _parity = line.config == SERIAL_8E1 ? 0 : 1;
+        _byte_bits = 11;
+    }
+    for (uint8_t l = 0; l < 2; l++)
+    {
+        _line_next[l] = _byte_bits;
+    }
+}
+
+/**
+ * @brief Write the header of the file: the signals and their initial values
+ */
+void VCDWriter::begin()
+{
+    _out.print(F("$timescale 1us $end\n"
+                 "$scope module kline $end\n"
+                 "$var wire 1 ! tx $end\n"
+                 "$var wire 1 \" rx $end\n"
+                 "$var wire 8 # tx_byte $end\n"
+                 "$var wire 8 $ rx_byte $end\n"
+                 "$var wire 2 % init $end\n"
+                 "$var wire 1 & p2 $end\n"
+                 "$var wire 1 ' p3 $end\n"
+                 "$var wire 1 ( checksum $end\n"
+                 "$upscope $end\n"
+                 "$enddefinitions $end\n"
+                 "#0\n"
+                 "$dumpvars\n1!\n1\"\nbx #\nbx $\nbx %\n0&\n0'\nx(\n$end\n"));
+}
+
+/**
+ * @brief Keep an event, call it from the trace callback. When the buffer is full the event is dropped
+ * 
+ * @param time When it happened, in microseconds
+ * @param event One of the `trace_event`
+ * @param value Its value
+ */
+void VCDWriter::add(const uint32_t time, const uint8_t event, const uint8_t value)
+{
+    if (_count == _buffer_len)
+    {
+        _dropped++;
+        return;
+    }
+    trace_record &record = _buffer[(_head + _count) % _buffer_len];
+    record.time = time;
+    record.event = event;
+    record.value = value;
+    _count++;
+}
+
+/**
+ * @brief Write the events kept, call it in the loop when the K-Line is quiet (e.g. after `update()`)
+ */
+void VCDWriter::write()
+{
+    if (_dropped != 0)
+    {
+        _out.print(F("$comment "));
+        _out.print(_dropped);
+        _out.print(F(" events dropped, write() more often or use a bigger buffer $end\n"));
+        _dropped = 0;
+    }
+
+    while (_count > 0)
+    {
+        writeRecord(_buffer[_head]);
+        _head = (_head + 1) % _buffer_len;
+        _count--;
+    }
+
+    // finish the bytes which ended before now, the next RX byte can't start earlier
+    if (_started == true)
+    {
+        const uint32_t now = KWP2000_MICROS() - _origin;
+        const uint32_t frame = _bit_time * _byte_bits * 2 / 16;
+        if (now > frame && now - frame > _last_time)
+        {
+            advance(now - frame);
+        }
+    }
+}
+
+/**
+ * @brief Get how many events have been dropped since the last `write()`
+ * 
+ * @return The number of events
+ */
+uint16_t VCDWriter::getDropped()
+{
+    return _dropped;
+}
+
+/**
+ * @brief Write an event, with the bits of the lines until its time
+ * 
+ * @param record The event
+ */
+void VCDWriter::writeRecord(const trace_record &record)
+{
+    if (_started == false)
+    {
+        _started = true;
+        _origin = record.time;
+    }
+    const uint32_t time = record.time - _origin;
+
+    switch (record.event)
+    {
+    case TRACE_TX:
+        startByte(LINE_TX, time, record.value);
+        break;
+
+    case TRACE_RX:
+        // it is read when its stop bit is over
+        startByte(LINE_RX, time > _bit_time * _byte_bits / 16 ? time - _bit_time * _byte_bits / 16 : 0, record.value);
+        break;
+
+    case TRACE_K_OUT:
+        // the fast init drives the TX line by hand
+        advance(time);
+        stamp(time);
+        _line_level[LINE_TX] = record.value;
+        writeValue(record.value, 1, '!');
+        break;
+
+    case TRACE_INIT:
+        advance(time);
+        stamp(time);
+        writeValue(record.value, 2, '%');
+        break;
+
+    case TRACE_P2:
+        advance(time);
+        stamp(time);
+        writeValue(record.value, 1, '&');
+        break;
+
+    case TRACE_P3:
+        advance(time);
+        stamp(time);
+        writeValue(record.value, 1, '\'');
+        break;
+
+    case TRACE_CHECKSUM:
+        advance(time);
+        stamp(time);
+        writeValue(record.value, 1, '(');
+        break;
+
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Start a byte on a line, after the end of the previous one
+ * 
+ * @param line `LINE_TX` or `LINE_RX`
+ * @param start When its start bit begins, from the first event
+ * @param value The byte
+ */
+void VCDWriter::startByte(const uint8_t line, uint32_t start, const uint8_t value)
+{
+    // the UART sends one byte after the other
+    advance(start);
+    if (_line_next[line] < _byte_bits)
+    {
+        const uint32_t end = bitTime(line, _byte_bits);
+        advance(end);
+        start = end;
+    }
+    if (start < _last_time)
+    {
+        start = _last_time;
+    }
+
+    _line_start[line] = start;
+    _line_bits[line] = (uint16_t)value << 1 | 1 << (_byte_bits - 1); // the start bit is 0
+    if (_parity != NO_PARITY)
+    {
+        uint8_t parity = _parity;
+        for (uint8_t b = 0; b < 8; b++)
+        {
+            parity ^= (value >> b) & 0x01;
+        }
+        _line_bits[line] |= (uint16_t)parity << 9;
+    }
+    _line_next[line] = 0;
+
+    stamp(start);
+    writeValue(value, 8, line == LINE_TX ? '#' : '$');
+}
+
+/**
+ * @brief When a bit of the byte on a line begins
+ * 
+ * @param line `LINE_TX` or `LINE_RX`
+ * @param bit From `0` (the start bit) to `_byte_bits` (the end of the stop bit)
+ * @return The time, from the first event
+ */
+uint32_t VCDWriter::bitTime(const uint8_t line, const uint8_t bit)
+{
+    return _line_start[line] + (_bit_time * bit + 8) / 16;
+}
+
+/**
+ * @brief Write the bits of both lines which begin before a time, in order
+ * 
+ * @param until The time, from the first event
+ */
+void VCDWriter::advance(const uint32_t until)
+{
+    for (;;)
+    {
+        uint8_t next = 2;
+        uint32_t next_time = until;
+        for (uint8_t line = 0; line < 2; line++)
+        {
+            if (_line_next[line] < _byte_bits && bitTime(line, _line_next[line]) <= next_time)
+            {
+                next = line;
+                next_time = bitTime(line, _line_next[line]);
+            }
+        }
+        if (next == 2)
+        {
+            return;
+        }
+
+        const uint8_t level = (_line_bits[next] >> _line_next[next]) & 0x01;
+        _line_next[next]++;
+        if (level != _line_level[next])
+        {
+            _line_level[next] = level;
+            stamp(next_time);
+            writeValue(level, 1, next == LINE_TX ? '!' : '"');
+        }
+    }
+}
+
+/**
+ * @brief Write the time of the next changes, if it is not the same of the last ones
+ * 
+ * @param time From the first event, never before the last one
+ */
+void VCDWriter::stamp(uint32_t time)
+{
+    if (time < _last_time)
+    {
+        time = _last_time;
+    }
+    if (time != _last_time)
+    {
+        _out.print('#');
+        _out.print(time);
+        _out.print('\n');
+        _last_time = time;
+    }
+}
+
+/**
+ * @brief Write the value of a signal at the last time written
+ * 
+ * @param value The value
+ * @param bits The width of the signal
+ * @param id The identifier of the signal in the header
+ */
+void VCDWriter::writeValue(const uint8_t value, const uint8_t bits, const char id)
+{
+    if (bits == 1)
+    {
+        _out.print(value != 0 ? '1' : '0');
+    }
+    else
+    {
+        _out.print('b');
+        for (int8_t b = bits - 1; b >= 0; b--)
+        {
+            _out.print((value >> b) & 0x01 ? '1' : '0');
+        }
+        _out.print(' ');
+    }
+    _out.print(id);
+    _out.print('\n');
+}
@@ -0,0 +1,76 @@
+/*
+VCDWriter.h
+
+Copyright (c) 2019 Aster94
+
+Permission is hereby granted, free of charge, to any person obtaining a copy of this software 
+and associated documentation files (the "Software"), to deal in the Software without restriction, 
+including without limitation the rights to use, copy, modify, merge, publish, distribute, 
+sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is 
+furnished to do so, subject to the following conditions:
+
+The above copyright notice and this permission notice shall be included in all copies or 
+substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING 
+BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND 
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, 
+DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, 
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef VCDWriter_h
+#define VCDWriter_h
+
+#include "Arduino.h"
+#include "KWP2000.h"
+
+/**
+ * @brief An event of the trace kept by `VCDWriter` until it is written
+ */
+struct trace_record
+{
+    uint32_t time; ///< in microseconds
+    uint8_t event; ///< one of the `trace_event`
+    uint8_t value;
+};
+
+class VCDWriter
+{
+  public:
+    VCDWriter(Print &out, trace_record buffer[], const uint16_t buffer_len, const uint32_t baudrate = 10400, const uint32_t config = SERIAL_8O1);
+    void setLineConfig(const line_config_t &line);
+    void begin();
+    void add(const uint32_t time, const uint8_t event, const uint8_t value);
+    void write();
+    uint16_t getDropped();
+
+  private:
+    Print &_out;
+    trace_record *const _buffer;
+    const uint16_t _buffer_len;
+    uint16_t _head = 0; // next record to write
+    uint16_t _count = 0;
+    uint16_t _dropped = 0;
+    uint32_t _bit_time; // microseconds of a bit, x 16
+    uint8_t _byte_bits; // start, 8 data, the parity if any and stop
+    uint8_t _parity;    // the parity bit of a byte with even ones, 2 without the parity bit
+    uint8_t _started = false;
+    uint32_t _origin = 0;    // time of the first event, it is the 0 of the file
+    uint32_t _last_time = 0; // of the last change written, from _origin
+
+    // the bits of the last byte of each line: start, 8 data, parity and stop
+    uint32_t _line_start[2];
+    uint16_t _line_bits[2];
+    uint8_t _line_next[2]; // next bit to write, _byte_bits when the byte is over
+    uint8_t _line_level[2];
+
+    void stamp(uint32_t time);
+    void advance(const uint32_t until);
+    uint32_t bitTime(const uint8_t line, const uint8_t bit);
+    void startByte(const uint8_t line, uint32_t start, const uint8_t value);
+    void writeValue(const uint8_t value, const uint8_t bits, const char id);
+    void writeRecord(const trace_record &record);
+};
+
+#endif // VCDWriter_h